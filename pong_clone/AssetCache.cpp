@@ -0,0 +1,401 @@
+/**
+ * @file AssetCache.cpp
+ * @brief Cooked file layout (little-endian):
+ *
+ *   CookedHeader (64 bytes)
+ *   payload: width * height * 4 bytes of RGBA, raw or LZ-compressed
+ *
+ * The header is a multiple of 16 bytes, so a raw payload is suitably
+ * aligned to be uploaded directly from the mapping.
+ */
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sys/stat.h>
+#include "AssetCache.h"
+#include "stb_image.h"
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <unistd.h>
+#endif
+
+constexpr char COOKED_EXTENSION[] = ".cooked";
+constexpr uint32_t COOKED_MAGIC = 0x4B435450; // "PTCK"
+constexpr uint32_t COOKED_VERSION = 1;
+
+enum CookedCompression : uint32_t { COMPRESSION_NONE = 0, COMPRESSION_LZ = 1 };
+
+struct CookedHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t compression;
+    uint32_t downscale_steps;
+    uint64_t source_size;
+    int64_t  source_mtime;
+    uint64_t payload_size;
+    uint8_t  reserved[16];
+};
+static_assert(sizeof(CookedHeader) == 64, "cooked header must stay 64 bytes");
+
+/* LZ COMPRESSION */
+
+constexpr size_t LZ_MIN_MATCH = 4;
+constexpr size_t LZ_MAX_OFFSET = 65535;
+constexpr int LZ_HASH_BITS = 16;
+
+static uint32_t read_u32(const unsigned char *p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static void write_length(std::vector<unsigned char> &destination, size_t length)
+{
+    while (length >= 255)
+    {
+        destination.push_back(255);
+        length -= 255;
+    }
+    destination.push_back((unsigned char)length);
+}
+
+// One sequence: token (literal count, match length - 4), the literals, then
+// a 16-bit offset back to the match. The final sequence has no match.
+static void write_sequence(std::vector<unsigned char> &destination, const unsigned char *literals,
+    size_t literal_count, size_t offset, size_t match_length)
+{
+    size_t match_code = match_length ? match_length - LZ_MIN_MATCH : 0;
+    unsigned char token = (unsigned char)((literal_count < 15 ? literal_count : 15) << 4);
+    token |= (unsigned char)(match_code < 15 ? match_code : 15);
+    destination.push_back(token);
+
+    if (literal_count >= 15) write_length(destination, literal_count - 15);
+    destination.insert(destination.end(), literals, literals + literal_count);
+
+    if (match_length == 0) return;
+
+    destination.push_back((unsigned char)(offset & 0xFF));
+    destination.push_back((unsigned char)(offset >> 8));
+    if (match_code >= 15) write_length(destination, match_code - 15);
+}
+
+void lz_compress(const unsigned char *source, size_t source_size, std::vector<unsigned char> &destination)
+{
+    destination.clear();
+    std::vector<uint32_t> table((size_t)1 << LZ_HASH_BITS, UINT32_MAX);
+
+    size_t anchor = 0,
+        position = 0;
+
+    while (position + LZ_MIN_MATCH <= source_size)
+    {
+        uint32_t sequence = read_u32(source + position);
+        uint32_t hash = (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+        uint32_t candidate = table[hash];
+        table[hash] = (uint32_t)position;
+
+        if (candidate != UINT32_MAX and position - candidate <= LZ_MAX_OFFSET and read_u32(source + candidate) == sequence)
+        {
+            size_t length = LZ_MIN_MATCH;
+            while (position + length < source_size and source[candidate + length] == source[position + length]) length++;
+
+            write_sequence(destination, source + anchor, position - anchor, position - candidate, length);
+            position += length;
+            anchor = position;
+        }
+        else
+        {
+            position++;
+        }
+    }
+
+    write_sequence(destination, source + anchor, source_size - anchor, 0, 0);
+}
+
+static bool read_length(const unsigned char *&in, const unsigned char *in_end, size_t &length)
+{
+    unsigned char byte;
+    do
+    {
+        if (in >= in_end) return false;
+        byte = *in++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+bool lz_decompress(const unsigned char *source, size_t source_size, unsigned char *destination, size_t destination_size)
+{
+    const unsigned char *in = source, *in_end = source + source_size;
+    unsigned char *out = destination, *out_end = destination + destination_size;
+
+    while (in < in_end)
+    {
+        unsigned char token = *in++;
+
+        size_t literal_count = token >> 4;
+        if (literal_count == 15 and not read_length(in, in_end, literal_count)) return false;
+        if (literal_count > (size_t)(in_end - in) or literal_count > (size_t)(out_end - out)) return false;
+        memcpy(out, in, literal_count);
+        in += literal_count;
+        out += literal_count;
+
+        if (in == in_end) break; // the last sequence carries no match
+
+        if (in_end - in < 2) return false;
+        size_t offset = in[0] | (in[1] << 8);
+        in += 2;
+
+        size_t match_length = token & 15;
+        if (match_length == 15 and not read_length(in, in_end, match_length)) return false;
+        match_length += LZ_MIN_MATCH;
+
+        if (offset == 0 or offset > (size_t)(out - destination) or match_length > (size_t)(out_end - out)) return false;
+
+        // Matches may overlap their own output, so copy forwards; whole
+        // words at a time when they are far enough apart
+        const unsigned char *match = out - offset;
+        if (offset >= sizeof(uint64_t))
+        {
+            size_t i = 0;
+            for (; i + sizeof(uint64_t) <= match_length; i += sizeof(uint64_t)) memcpy(out + i, match + i, sizeof(uint64_t));
+            for (; i < match_length; i++) out[i] = match[i];
+        }
+        else
+        {
+            for (size_t i = 0; i < match_length; i++) out[i] = match[i];
+        }
+        out += match_length;
+    }
+
+    return out == out_end;
+}
+
+/* COOKING */
+
+std::string cooked_path(const char *source_path)
+{
+    return std::string(source_path) + COOKED_EXTENSION;
+}
+
+static bool source_stamp(const char *source_path, uint64_t &size, int64_t &mtime)
+{
+    struct stat info;
+    if (stat(source_path, &info) != 0) return false;
+    size = (uint64_t)info.st_size;
+    mtime = (int64_t)info.st_mtime;
+    return true;
+}
+
+// Halves an RGBA image, weighting colour by alpha so transparent texels do
+// not darken the edges
+static void downscale_half(const unsigned char *source, int width, int height, std::vector<unsigned char> &destination, int &out_width, int &out_height)
+{
+    out_width = width > 1 ? width / 2 : 1;
+    out_height = height > 1 ? height / 2 : 1;
+    destination.assign((size_t)out_width * out_height * 4, 0);
+
+    for (int y = 0; y < out_height; y++)
+    {
+        for (int x = 0; x < out_width; x++)
+        {
+            unsigned sum[4] = { 0, 0, 0, 0 };
+            for (int dy = 0; dy < 2; dy++)
+            {
+                for (int dx = 0; dx < 2; dx++)
+                {
+                    int sx = x * 2 + dx < width ? x * 2 + dx : width - 1,
+                        sy = y * 2 + dy < height ? y * 2 + dy : height - 1;
+                    const unsigned char *texel = source + ((size_t)sy * width + sx) * 4;
+                    for (int c = 0; c < 3; c++) sum[c] += texel[c] * texel[3];
+                    sum[3] += texel[3];
+                }
+            }
+
+            unsigned char *out = destination.data() + ((size_t)y * out_width + x) * 4;
+            for (int c = 0; c < 3; c++) out[c] = (unsigned char)(sum[3] ? sum[c] / sum[3] : 0);
+            out[3] = (unsigned char)((sum[3] + 2) / 4);
+        }
+    }
+}
+
+bool cook_asset(const char *source_path, int downscale_steps, bool compress)
+{
+    CookedHeader header = {};
+    header.magic = COOKED_MAGIC;
+    header.version = COOKED_VERSION;
+    if (not source_stamp(source_path, header.source_size, header.source_mtime))
+    {
+        std::cout << "Unable to stat " << source_path << std::endl;
+        return false;
+    }
+
+    int width, height, number_of_components;
+    std::vector<unsigned char> pixels;
+    bool decoded = stbi_info(source_path, &width, &height, &number_of_components);
+    if (decoded)
+    {
+        pixels.resize((size_t)width * height * 4);
+        decoded = stbi_load_into(source_path, pixels.data(), width * 4, width, height,
+            &width, &height, &number_of_components, STBI_rgb_alpha);
+    }
+    if (not decoded)
+    {
+        std::cout << "Unable to load image " << source_path << ": " << stbi_failure_reason() << std::endl;
+        return false;
+    }
+
+    for (int step = 0; step < downscale_steps; step++)
+    {
+        std::vector<unsigned char> smaller;
+        downscale_half(pixels.data(), width, height, smaller, width, height);
+        pixels.swap(smaller);
+    }
+
+    header.width = (uint32_t)width;
+    header.height = (uint32_t)height;
+    header.downscale_steps = (uint32_t)downscale_steps;
+
+    std::vector<unsigned char> compressed;
+    if (compress) lz_compress(pixels.data(), pixels.size(), compressed);
+
+    const std::vector<unsigned char> &payload = compress and compressed.size() < pixels.size() ? compressed : pixels;
+    header.compression = &payload == &compressed ? COMPRESSION_LZ : COMPRESSION_NONE;
+    header.payload_size = payload.size();
+
+    std::string path = cooked_path(source_path);
+    FILE *file = fopen(path.c_str(), "wb");
+    if (file == NULL)
+    {
+        std::cout << "Unable to write " << path << std::endl;
+        return false;
+    }
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1
+        and fwrite(payload.data(), 1, payload.size(), file) == payload.size();
+    written = fclose(file) == 0 and written;
+
+    std::cout << "Cooked " << source_path << " -> " << path << " (" << width << "x" << height << ", "
+              << payload.size() << " of " << pixels.size() << " bytes)" << std::endl;
+    return written;
+}
+
+/* LOADING */
+
+static bool map_file(const std::string &path, CookedAsset &asset)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER size;
+    HANDLE mapping = NULL;
+    void *data = NULL;
+    if (GetFileSizeEx(file, &size) and size.QuadPart > 0)
+    {
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping != NULL) data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    }
+    if (data == NULL)
+    {
+        if (mapping != NULL) CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    asset.file_handle = file;
+    asset.mapping_handle = mapping;
+    asset.mapped_data = data;
+    asset.mapped_size = (size_t)size.QuadPart;
+#else
+    int file = open(path.c_str(), O_RDONLY);
+    if (file < 0) return false;
+
+    struct stat info;
+    void *data = MAP_FAILED;
+    if (fstat(file, &info) == 0 and info.st_size > 0)
+    {
+        data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    }
+    close(file); // the mapping keeps the file alive
+    if (data == MAP_FAILED) return false;
+
+    asset.mapped_data = data;
+    asset.mapped_size = (size_t)info.st_size;
+#endif
+    return true;
+}
+
+bool open_cooked_asset(const char *source_path, CookedAsset &asset)
+{
+    asset = CookedAsset();
+
+    uint64_t source_size;
+    int64_t source_mtime;
+    if (not source_stamp(source_path, source_size, source_mtime)) return false;
+    if (not map_file(cooked_path(source_path), asset)) return false;
+
+    CookedHeader header;
+    bool valid = asset.mapped_size >= sizeof(header);
+    if (valid)
+    {
+        memcpy(&header, asset.mapped_data, sizeof(header));
+        uint64_t pixel_bytes = (uint64_t)header.width * header.height * 4;
+
+        valid = header.magic == COOKED_MAGIC and header.version == COOKED_VERSION
+            and header.source_size == source_size and header.source_mtime == source_mtime
+            and header.payload_size <= asset.mapped_size - sizeof(header)
+            and (header.compression == COMPRESSION_LZ or header.payload_size == pixel_bytes);
+    }
+    if (not valid)
+    {
+        close_cooked_asset(asset);
+        return false;
+    }
+
+    const unsigned char *payload = (const unsigned char *)asset.mapped_data + sizeof(header);
+    asset.image.width = (int)header.width;
+    asset.image.height = (int)header.height;
+
+    if (header.compression == COMPRESSION_NONE)
+    {
+        asset.image.pixels = payload;
+        return true;
+    }
+
+    size_t pixel_bytes = (size_t)header.width * header.height * 4;
+    asset.decompressed = new unsigned char[pixel_bytes];
+    if (not lz_decompress(payload, (size_t)header.payload_size, asset.decompressed, pixel_bytes))
+    {
+        close_cooked_asset(asset);
+        return false;
+    }
+    asset.image.pixels = asset.decompressed;
+    return true;
+}
+
+void close_cooked_asset(CookedAsset &asset)
+{
+    delete[] asset.decompressed;
+
+#ifdef _WIN32
+    if (asset.mapped_data != nullptr) UnmapViewOfFile(asset.mapped_data);
+    if (asset.mapping_handle != nullptr) CloseHandle((HANDLE)asset.mapping_handle);
+    if (asset.file_handle != nullptr) CloseHandle((HANDLE)asset.file_handle);
+#else
+    if (asset.mapped_data != nullptr) munmap(asset.mapped_data, asset.mapped_size);
+#endif
+
+    asset = CookedAsset();
+}
@@ -0,0 +1,50 @@
+/**
+ * @file AssetCache.h
+ * @brief Pre-cooked image cache. cook_asset() decodes a PNG/JPEG once and
+ * writes "<source>.cooked": a fixed header followed by the RGBA pixels,
+ * either raw or LZ-compressed and optionally pre-downscaled. At run
+ * time open_cooked_asset() maps that file and hands the pixels straight to
+ * the GL upload, skipping stb_image entirely.
+ *
+ * A cooked file remembers the size and modification time of the source it
+ * came from; if either has changed the cache is stale and the caller should
+ * fall back to decoding the source.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "TextureAtlas.h"
+
+// Pixels of an opened cooked file and what has to be released afterwards
+struct CookedAsset
+{
+    AtlasImage image;
+
+    void *mapped_data = nullptr;   // the whole file, mapped read-only
+    size_t mapped_size = 0;
+    unsigned char *decompressed = nullptr; // only for compressed payloads
+
+#ifdef _WIN32
+    void *file_handle = nullptr;
+    void *mapping_handle = nullptr;
+#endif
+};
+
+std::string cooked_path(const char *source_path);
+
+// Halves the image downscale_steps times (box filter, alpha weighted) and
+// compresses the pixels when that makes the file smaller
+bool cook_asset(const char *source_path, int downscale_steps, bool compress);
+
+// Returns false, leaving asset empty, when there is no cooked file or it no
+// longer matches its source
+bool open_cooked_asset(const char *source_path, CookedAsset &asset);
+void close_cooked_asset(CookedAsset &asset);
+
+// LZ4-style byte-aligned sequences (literals, 16-bit offset, match length);
+// exposed for the cook step and for testing
+void lz_compress(const unsigned char *source, size_t source_size, std::vector<unsigned char> &destination);
+bool lz_decompress(const unsigned char *source, size_t source_size, unsigned char *destination, size_t destination_size);
@@ -0,0 +1,42 @@
+/**
+ * @file BallGrid.cpp
+ * @brief The table has at least twice as many buckets as live balls, so
+ * unrelated cells rarely share one; when they do it only costs extra
+ * candidates, never a missed pair.
+ */
+#include "BallGrid.h"
+
+void BallGrid::build(const float* x, const float* y, const uint8_t* alive, size_t count, float cell_size)
+{
+    m_inverse_cell_size = 1.0f / cell_size;
+
+    size_t bucket_count = 16;
+    while (bucket_count < count * 2) bucket_count *= 2;
+    m_bucket_mask = (uint32_t)(bucket_count - 1);
+
+    m_bucket_start.assign(bucket_count + 1, 0);
+    m_ball_bucket.resize(count);
+
+    // Count, prefix sum, scatter. Balls are scattered in index order, so each
+    // bucket lists its balls in index order and results never depend on
+    // anything but the positions.
+    size_t live = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (not alive[i]) continue;
+        uint32_t b = bucket((int)floorf(x[i] * m_inverse_cell_size), (int)floorf(y[i] * m_inverse_cell_size));
+        m_ball_bucket[i] = b;
+        m_bucket_start[b + 1]++;
+        live++;
+    }
+
+    for (size_t b = 0; b < bucket_count; b++) m_bucket_start[b + 1] += m_bucket_start[b];
+
+    m_bucket_cursor.assign(m_bucket_start.begin(), m_bucket_start.end() - 1);
+    m_sorted.resize(live);
+    for (size_t i = 0; i < count; i++)
+    {
+        if (not alive[i]) continue;
+        m_sorted[m_bucket_cursor[m_ball_bucket[i]]++] = (uint32_t)i;
+    }
+}
@@ -0,0 +1,69 @@
+/**
+ * @file BallGrid.h
+ * @brief BallGrid class declaration. A uniform spatial hash over ball centres
+ * with cells one ball wide, rebuilt from scratch every step with a counting
+ * sort. Any two touching balls then lie in the same or adjacent cells, so the
+ * 3x3 block of cells around a ball holds every candidate for a collision.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class BallGrid
+{
+private:
+    float m_inverse_cell_size = 1.0f;
+    uint32_t m_bucket_mask = 0;
+
+    // Ball indices grouped by bucket; bucket b holds
+    // m_sorted[m_bucket_start[b] .. m_bucket_start[b + 1])
+    std::vector<uint32_t> m_bucket_start;
+    std::vector<uint32_t> m_bucket_cursor;
+    std::vector<uint32_t> m_ball_bucket;
+    std::vector<uint32_t> m_sorted;
+
+    uint32_t bucket(int cell_x, int cell_y) const
+    {
+        return (((uint32_t)cell_x * 73856093u) ^ ((uint32_t)cell_y * 19349663u)) & m_bucket_mask;
+    };
+
+public:
+    // Hashes every live ball; dead balls never appear as candidates
+    void build(const float* x, const float* y, const uint8_t* alive, size_t count, float cell_size);
+
+    // Calls visit(j) for every ball in the 3x3 cells around (x, y) until it
+    // returns false. Cells that hash to the same bucket are visited once, so
+    // no ball is reported twice.
+    template <typename Visit>
+    void for_each_near(float x, float y, Visit visit) const
+    {
+        int cell_x = (int)floorf(x * m_inverse_cell_size),
+            cell_y = (int)floorf(y * m_inverse_cell_size);
+
+        uint32_t visited[9];
+        int visited_count = 0;
+        for (int offset_y = -1; offset_y <= 1; offset_y++)
+        {
+            for (int offset_x = -1; offset_x <= 1; offset_x++)
+            {
+                uint32_t b = bucket(cell_x + offset_x, cell_y + offset_y);
+
+                bool seen = false;
+                for (int i = 0; i < visited_count; i++) seen = seen or visited[i] == b;
+                if (seen) continue;
+                visited[visited_count++] = b;
+
+                for (uint32_t i = m_bucket_start[b]; i < m_bucket_start[b + 1]; i++)
+                {
+                    if (not visit(m_sorted[i])) return;
+                }
+            }
+        }
+    };
+
+    size_t get_bucket_count() const { return (size_t)m_bucket_mask + 1; };
+};
@@ -0,0 +1,27 @@
+/**
+ * @file CommandLine.cpp
+ */
+#include <cstring>
+#include "CommandLine.h"
+
+bool has_flag(int argc, char* argv[], const char* flag)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], flag) == 0) return true;
+    }
+    return false;
+}
+
+const char* find_option(int argc, char* argv[], const char* name)
+{
+    size_t length = strlen(name);
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], name, length) == 0 and argv[i][length] == '=')
+        {
+            return argv[i] + length + 1;
+        }
+    }
+    return nullptr;
+}
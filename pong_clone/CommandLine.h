@@ -0,0 +1,13 @@
+/**
+ * @file CommandLine.h
+ * @brief Helpers for the --flag and --name=value options shared by the game
+ * and the headless runner.
+ */
+
+#pragma once
+
+// True when argv contains exactly this flag
+bool has_flag(int argc, char* argv[], const char* flag);
+
+// Looks for --name=value and returns a pointer to value, or nullptr
+const char* find_option(int argc, char* argv[], const char* name);
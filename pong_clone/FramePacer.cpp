@@ -0,0 +1,170 @@
+/**
+ * @file FramePacer.cpp
+ * @brief Capped frames are scheduled against absolute deadlines, so an
+ * early or late wake-up is corrected on the next frame instead of drifting.
+ * Latency percentiles sort a copy of the window, which only happens when a
+ * report is asked for.
+ */
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include "FramePacer.h"
+
+static const char* const MODE_NAMES[] = { "vsync", "adaptive", "capped", "uncapped" };
+static const char* const LATENCY_NAMES[FramePacer::LATENCY_COUNT] = { "sample to present", "latch to present", "event to present" };
+
+const char* FramePacer::get_mode_name(Mode mode)
+{
+    return MODE_NAMES[mode];
+}
+
+const char* FramePacer::get_latency_name(Latency latency)
+{
+    return LATENCY_NAMES[latency];
+}
+
+bool FramePacer::parse_mode(const char* name, Mode& mode)
+{
+    for (int candidate = VSYNC; candidate <= UNCAPPED; candidate++)
+    {
+        if (strcmp(name, MODE_NAMES[candidate]) != 0) continue;
+        mode = (Mode)candidate;
+        return true;
+    }
+    return false;
+}
+
+FramePacer::Mode FramePacer::set_mode(Mode mode, double fps_cap)
+{
+    if (fps_cap > 0.0) m_frame_period = 1.0 / fps_cap;
+    m_next_deadline = 0;
+
+    if (mode == ADAPTIVE_VSYNC and SDL_GL_SetSwapInterval(-1) != 0) mode = VSYNC;
+    if (mode == VSYNC) SDL_GL_SetSwapInterval(1);
+    if (mode == CAPPED or mode == UNCAPPED) SDL_GL_SetSwapInterval(0);
+
+    m_mode = mode;
+    return m_mode;
+}
+
+void FramePacer::wait_for_next_frame()
+{
+    if (m_mode != CAPPED) return;
+
+    const double frequency = (double)SDL_GetPerformanceFrequency();
+    const Uint64 period = (Uint64)(m_frame_period * frequency);
+    Uint64 now = SDL_GetPerformanceCounter();
+
+    // First frame, or so far behind that catching up would mean a burst of
+    // unpaced frames: start counting from now instead
+    if (m_next_deadline == 0 or now > m_next_deadline + period)
+    {
+        if (m_next_deadline != 0) m_missed_deadlines++;
+        m_next_deadline = now + period;
+        return;
+    }
+
+    const Uint64 spin_margin = (Uint64)(SPIN_MARGIN_SECONDS * frequency);
+    if (m_next_deadline > now + spin_margin)
+    {
+        SDL_Delay((Uint32)((m_next_deadline - now - spin_margin) * 1000 / SDL_GetPerformanceFrequency()));
+    }
+    while (SDL_GetPerformanceCounter() < m_next_deadline) {}
+
+    m_next_deadline += period;
+}
+
+void FramePacer::mark_input_sampled()
+{
+    m_input_sampled = SDL_GetPerformanceCounter();
+}
+
+void FramePacer::mark_input_latched()
+{
+    m_input_latched = SDL_GetPerformanceCounter();
+}
+
+void FramePacer::note_input_event(Uint32 timestamp_ticks)
+{
+    if (m_has_presented_event and SDL_TICKS_PASSED(m_presented_event_ticks, timestamp_ticks)) return;
+
+    if (not m_has_event or SDL_TICKS_PASSED(m_oldest_event_ticks, timestamp_ticks)) m_oldest_event_ticks = timestamp_ticks;
+    if (not m_has_event or SDL_TICKS_PASSED(timestamp_ticks, m_newest_event_ticks)) m_newest_event_ticks = timestamp_ticks;
+    m_has_event = true;
+}
+
+void FramePacer::mark_presented()
+{
+    Uint64 now = SDL_GetPerformanceCounter();
+    const double frequency = (double)SDL_GetPerformanceFrequency();
+    if (m_input_sampled != 0) record(SAMPLE_TO_PRESENT, (double)(now - m_input_sampled) / frequency);
+    if (m_input_latched != 0) record(LATCH_TO_PRESENT, (double)(now - m_input_latched) / frequency);
+    m_input_latched = 0;
+
+    if (m_has_event)
+    {
+        record(EVENT_TO_PRESENT, (SDL_GetTicks() - m_oldest_event_ticks) / 1000.0);
+        m_presented_event_ticks = m_newest_event_ticks;
+        m_has_presented_event = true;
+        m_has_event = false;
+    }
+}
+
+void FramePacer::record(Latency latency, double seconds)
+{
+    std::vector<uint32_t>& samples = m_samples[latency];
+    if (samples.empty()) samples.assign(WINDOW_SAMPLES, 0);
+
+    samples[m_sample_count[latency] % WINDOW_SAMPLES] = (uint32_t)(std::max(seconds, 0.0) * 1e6);
+    m_sample_count[latency]++;
+}
+
+FrameProfiler::Summary FramePacer::get_summary(Latency latency) const
+{
+    FrameProfiler::Summary summary;
+    summary.samples = std::min(m_sample_count[latency], WINDOW_SAMPLES);
+    if (summary.samples == 0) return summary;
+
+    std::vector<uint32_t> sorted(m_samples[latency].begin(), m_samples[latency].begin() + summary.samples);
+    std::sort(sorted.begin(), sorted.end());
+
+    // Nearest rank
+    auto percentile = [&](double fraction)
+    {
+        size_t rank = (size_t)(fraction * summary.samples + 0.999999);
+        return sorted[std::min(std::max<size_t>(rank, 1), summary.samples) - 1] / 1000.0;
+    };
+    summary.p50_ms = percentile(0.50);
+    summary.p95_ms = percentile(0.95);
+    summary.p99_ms = percentile(0.99);
+    summary.max_ms = sorted.back() / 1000.0;
+    return summary;
+}
+
+std::string FramePacer::format_summary() const
+{
+    std::ostringstream out;
+    out.setf(std::ios::fixed);
+    out.precision(3);
+
+    out << "pacing: " << get_mode_name(m_mode);
+    if (m_mode == CAPPED) out << " at " << 1.0 / m_frame_period << " fps, " << m_missed_deadlines << " missed deadlines";
+    out << '\n';
+
+    for (int latency = 0; latency < LATENCY_COUNT; latency++)
+    {
+        FrameProfiler::Summary summary = get_summary((Latency)latency);
+        out << LATENCY_NAMES[latency] << ": p50 " << summary.p50_ms << " ms, p95 " << summary.p95_ms
+            << " ms, p99 " << summary.p99_ms << " ms, max " << summary.max_ms << " ms over "
+            << summary.samples << " frames\n";
+    }
+
+    FrameProfiler::Summary sampled = get_summary(SAMPLE_TO_PRESENT),
+        latched = get_summary(LATCH_TO_PRESENT);
+    if (latched.samples > 0)
+    {
+        out << "late latch saves: p50 " << sampled.p50_ms - latched.p50_ms << " ms, p95 "
+            << sampled.p95_ms - latched.p95_ms << " ms\n";
+    }
+    return out.str();
+}
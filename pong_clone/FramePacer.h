@@ -0,0 +1,86 @@
+/**
+ * @file FramePacer.h
+ * @brief FramePacer class declaration. Decides when the main loop starts its
+ * next frame: on vsync, on adaptive vsync (tearing rather than waiting when a
+ * frame runs late), at a fixed rate by sleeping and then spinning up to the
+ * deadline, or as fast as possible. It also measures how long input waits to
+ * reach the screen.
+ *
+ * Sample-to-present runs from the moment the keyboard state is read to the
+ * moment the swap returns, and covers every frame. Latch-to-present does the
+ * same from the late latch's re-read, on frames that had one. Event-to-present
+ * runs from the timestamp of the oldest key event first seen in the frame, to
+ * millisecond precision, and only covers frames that had one.
+ */
+
+#pragma once
+
+#include <SDL.h>
+#include <string>
+#include <vector>
+#include "FrameProfiler.h"
+
+class FramePacer
+{
+public:
+    enum Mode { VSYNC, ADAPTIVE_VSYNC, CAPPED, UNCAPPED };
+    enum Latency { SAMPLE_TO_PRESENT, LATCH_TO_PRESENT, EVENT_TO_PRESENT, LATENCY_COUNT };
+
+    static constexpr double DEFAULT_FPS_CAP = 120.0;
+
+    // SDL_Delay can oversleep by about a millisecond, so a capped frame
+    // sleeps until this long before its deadline and spins the rest
+    static constexpr double SPIN_MARGIN_SECONDS = 0.002;
+
+    // Percentiles are taken over this many of the latest samples
+    static constexpr size_t WINDOW_SAMPLES = 1024;
+
+private:
+    Mode m_mode = VSYNC;
+    double m_frame_period = 1.0 / DEFAULT_FPS_CAP;
+    Uint64 m_next_deadline = 0;
+    int m_missed_deadlines = 0;
+
+    Uint64 m_input_sampled = 0;
+    Uint64 m_input_latched = 0;
+    Uint32 m_oldest_event_ticks = 0,
+        m_newest_event_ticks = 0,
+        m_presented_event_ticks = 0; // newest event already counted
+    bool m_has_event = false,
+        m_has_presented_event = false;
+
+    // Microseconds, in rings of WINDOW_SAMPLES
+    std::vector<uint32_t> m_samples[LATENCY_COUNT];
+    size_t m_sample_count[LATENCY_COUNT] = {};
+
+    void record(Latency latency, double seconds);
+
+public:
+    // Sets the swap interval for mode. A driver without adaptive vsync gets
+    // plain vsync; returns the mode that actually took effect.
+    Mode set_mode(Mode mode, double fps_cap = DEFAULT_FPS_CAP);
+
+    // Blocks until the next frame should start; only CAPPED ever waits here,
+    // the vsync modes wait inside the swap
+    void wait_for_next_frame();
+
+    // Called when the frame reads the keyboard, when a late latch re-reads
+    // it, for each key event seen, and once the swap has returned. An event
+    // seen by a late latch and again the next frame only counts once.
+    void mark_input_sampled();
+    void mark_input_latched();
+    void note_input_event(Uint32 timestamp_ticks);
+    void mark_presented();
+
+    FrameProfiler::Summary get_summary(Latency latency) const;
+    std::string format_summary() const;
+
+    Mode get_mode() const { return m_mode; };
+    int get_missed_deadlines() const { return m_missed_deadlines; };
+
+    // "vsync", "adaptive", "capped" or "uncapped"; parse_mode returns false
+    // for anything else and leaves mode alone
+    static const char* get_mode_name(Mode mode);
+    static bool parse_mode(const char* name, Mode& mode);
+    static const char* get_latency_name(Latency latency);
+};
@@ -0,0 +1,165 @@
+/**
+ * @file FrameProfiler.cpp
+ * @brief Each phase keeps a ring of its last WINDOW_FRAMES samples alongside
+ * a bucket histogram of the same samples, updated as samples enter and leave
+ * the ring, so reading a percentile never needs a sort.
+ */
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
+#include "FrameProfiler.h"
+
+static const char* const PHASE_NAMES[FrameProfiler::PHASE_COUNT] = { "pace", "input", "update", "render", "swap", "frame" };
+
+static size_t bucket_for(uint32_t microseconds)
+{
+    size_t bucket = (size_t)(microseconds / (FrameProfiler::BUCKET_MS * 1000.0));
+    return std::min(bucket, FrameProfiler::BUCKET_COUNT - 1);
+}
+
+FrameProfiler::FrameProfiler()
+{
+    for (int phase = 0; phase < PHASE_COUNT; phase++)
+    {
+        m_samples[phase].assign(WINDOW_FRAMES, 0);
+        m_buckets[phase].assign(BUCKET_COUNT, 0);
+    }
+}
+
+const char* FrameProfiler::get_phase_name(Phase phase)
+{
+    return PHASE_NAMES[phase];
+}
+
+void FrameProfiler::begin_frame()
+{
+    m_frame_start = Clock::now();
+    m_last_mark = m_frame_start;
+    std::fill(m_current, m_current + PHASE_COUNT, 0);
+}
+
+void FrameProfiler::mark(Phase phase)
+{
+    Clock::time_point now = Clock::now();
+    m_current[phase] += (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(now - m_last_mark).count();
+    m_last_mark = now;
+}
+
+void FrameProfiler::end_frame()
+{
+    m_current[FRAME] = (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - m_frame_start).count();
+
+    for (int phase = 0; phase < PHASE_COUNT; phase++)
+    {
+        record((Phase)phase, m_current[phase]);
+    }
+
+    m_next_slot = (m_next_slot + 1) % WINDOW_FRAMES;
+    if (m_window_size < WINDOW_FRAMES) m_window_size++;
+    m_frame_count++;
+}
+
+void FrameProfiler::record(Phase phase, uint32_t microseconds)
+{
+    uint32_t& slot = m_samples[phase][m_next_slot];
+    if (m_window_size == WINDOW_FRAMES) m_buckets[phase][bucket_for(slot)]--;
+
+    slot = microseconds;
+    m_buckets[phase][bucket_for(microseconds)]++;
+}
+
+FrameProfiler::Summary FrameProfiler::get_summary(Phase phase) const
+{
+    Summary summary;
+    summary.samples = m_window_size;
+    if (m_window_size == 0) return summary;
+
+    // Each percentile reports the upper edge of the bucket it falls in
+    const double percentiles[] = { 0.50, 0.95, 0.99 };
+    double* results[] = { &summary.p50_ms, &summary.p95_ms, &summary.p99_ms };
+
+    size_t seen = 0, next = 0;
+    for (size_t bucket = 0; bucket < BUCKET_COUNT and next < 3; bucket++)
+    {
+        seen += m_buckets[phase][bucket];
+        while (next < 3 and seen >= (size_t)(percentiles[next] * m_window_size + 0.5))
+        {
+            *results[next++] = (bucket + 1) * BUCKET_MS;
+        }
+    }
+
+    uint32_t max_microseconds = *std::max_element(m_samples[phase].begin(), m_samples[phase].begin() + m_window_size);
+    summary.max_ms = max_microseconds / 1000.0;
+
+    // A percentile can't exceed the slowest sample
+    for (double* result : results) *result = std::min(*result, summary.max_ms);
+
+    return summary;
+}
+
+std::string FrameProfiler::format_summary() const
+{
+    std::ostringstream out;
+    out.setf(std::ios::fixed);
+    out.precision(3);
+
+    for (int phase = 0; phase < PHASE_COUNT; phase++)
+    {
+        Summary summary = get_summary((Phase)phase);
+        out << PHASE_NAMES[phase] << ": p50 " << summary.p50_ms << " ms, p95 " << summary.p95_ms
+            << " ms, p99 " << summary.p99_ms << " ms, max " << summary.max_ms << " ms\n";
+    }
+    return out.str();
+}
+
+bool FrameProfiler::write_csv(const char* filepath) const
+{
+    FILE* file = fopen(filepath, "w");
+    if (file == NULL) return false;
+
+    fprintf(file, "frame");
+    for (int phase = 0; phase < PHASE_COUNT; phase++) fprintf(file, ",%s_ms", PHASE_NAMES[phase]);
+    fprintf(file, "\n");
+
+    size_t oldest = m_window_size == WINDOW_FRAMES ? m_next_slot : 0;
+    uint64_t first_frame = m_frame_count - m_window_size;
+    for (size_t i = 0; i < m_window_size; i++)
+    {
+        size_t slot = (oldest + i) % WINDOW_FRAMES;
+        fprintf(file, "%llu", (unsigned long long)(first_frame + i));
+        for (int phase = 0; phase < PHASE_COUNT; phase++) fprintf(file, ",%.3f", m_samples[phase][slot] / 1000.0);
+        fprintf(file, "\n");
+    }
+
+    return fclose(file) == 0;
+}
+
+bool FrameProfiler::write_json(const char* filepath) const
+{
+    FILE* file = fopen(filepath, "w");
+    if (file == NULL) return false;
+
+    fprintf(file, "{\n  \"frames\": %llu,\n  \"window\": %zu,\n  \"bucket_ms\": %g,\n  \"phases\": {\n",
+        (unsigned long long)m_frame_count, m_window_size, BUCKET_MS);
+
+    for (int phase = 0; phase < PHASE_COUNT; phase++)
+    {
+        Summary summary = get_summary((Phase)phase);
+        fprintf(file, "    \"%s\": {\"p50_ms\": %.3f, \"p95_ms\": %.3f, \"p99_ms\": %.3f, \"max_ms\": %.3f, \"histogram\": {",
+            PHASE_NAMES[phase], summary.p50_ms, summary.p95_ms, summary.p99_ms, summary.max_ms);
+
+        // Keyed by each bucket's lower edge in milliseconds
+        bool first = true;
+        for (size_t bucket = 0; bucket < BUCKET_COUNT; bucket++)
+        {
+            if (m_buckets[phase][bucket] == 0) continue;
+            fprintf(file, "%s\"%.2f\": %u", first ? "" : ", ", bucket * BUCKET_MS, m_buckets[phase][bucket]);
+            first = false;
+        }
+
+        fprintf(file, "}}%s\n", phase + 1 < PHASE_COUNT ? "," : "");
+    }
+
+    fprintf(file, "  }\n}\n");
+    return fclose(file) == 0;
+}
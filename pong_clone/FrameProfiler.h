@@ -0,0 +1,76 @@
+/**
+ * @file FrameProfiler.h
+ * @brief FrameProfiler class declaration. Times each phase of the main loop
+ * and keeps a histogram over the most recent frames, from which p50, p95,
+ * p99 and max can be read at any time or written out as CSV or JSON.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class FrameProfiler
+{
+public:
+    // PACE is time spent waiting for the frame pacer before any work
+    enum Phase { PACE, INPUT, UPDATE, RENDER, SWAP, FRAME, PHASE_COUNT };
+
+    struct Summary
+    {
+        double p50_ms = 0.0;
+        double p95_ms = 0.0;
+        double p99_ms = 0.0;
+        double max_ms = 0.0;
+        size_t samples = 0;
+    };
+
+    // Percentiles are taken over this many of the latest frames
+    static constexpr size_t WINDOW_FRAMES = 1024;
+
+    // Histogram resolution; anything slower lands in the last bucket
+    static constexpr double BUCKET_MS = 0.05;
+    static constexpr size_t BUCKET_COUNT = 2000;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    // Samples are stored in whole microseconds
+    std::vector<uint32_t> m_samples[PHASE_COUNT];
+    std::vector<uint32_t> m_buckets[PHASE_COUNT];
+
+    size_t m_next_slot = 0;
+    size_t m_window_size = 0;
+    uint64_t m_frame_count = 0;
+
+    Clock::time_point m_frame_start;
+    Clock::time_point m_last_mark;
+    uint32_t m_current[PHASE_COUNT] = {};
+
+    void record(Phase phase, uint32_t microseconds);
+
+public:
+    FrameProfiler();
+
+    void begin_frame();
+
+    // Charges the time since the previous mark (or begin_frame) to phase
+    void mark(Phase phase);
+
+    void end_frame();
+
+    Summary get_summary(Phase phase) const;
+    uint64_t get_frame_count() const { return m_frame_count; };
+
+    // One line per phase: name, p50, p95, p99, max
+    std::string format_summary() const;
+
+    // The CSV holds one row per frame in the window, oldest first; the JSON
+    // holds the summaries and the non-empty histogram buckets
+    bool write_csv(const char* filepath) const;
+    bool write_json(const char* filepath) const;
+
+    static const char* get_phase_name(Phase phase);
+};
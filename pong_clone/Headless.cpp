@@ -0,0 +1,367 @@
+/**
+ * @file Headless.cpp
+ * @brief Headless match runner. Both paddles are driven by a simple
+ * ball-tracking bot whose reaction distance is drawn per match from a seeded
+ * RNG, so a run with the same seed always plays out the same way.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "CommandLine.h"
+#include "Headless.h"
+#include "InputLog.h"
+#include "JobSystem.h"
+#include "MatchBatch.h"
+#include "Simulation.h"
+
+constexpr int DEFAULT_MATCHES = 1000;
+constexpr float DEFAULT_FIXED_DT = 1.0f / 60.0f;
+constexpr unsigned DEFAULT_SEED = 1;
+
+// A ball that nobody can miss any more would otherwise run forever
+constexpr float MAX_MATCH_SECONDS = 60.0f * 60.0f;
+
+constexpr float MIN_REACTION_DISTANCE = 1.0f,
+MAX_REACTION_DISTANCE = 9.0f;
+
+struct HeadlessOptions
+{
+    int matches = DEFAULT_MATCHES;
+    float fixed_dt = DEFAULT_FIXED_DT;
+    unsigned seed = DEFAULT_SEED;
+    int balls = 1;
+    bool batch = false;
+    MatchBatch::Kernel kernel = MatchBatch::best_kernel();
+    unsigned threads = JobSystem::default_worker_count() + 1;
+};
+
+static HeadlessOptions parse_options(int argc, char* argv[])
+{
+    HeadlessOptions options;
+
+    if (const char* value = find_option(argc, argv, "--matches")) options.matches = atoi(value);
+    if (const char* value = find_option(argc, argv, "--dt"))      options.fixed_dt = (float)atof(value);
+    if (const char* value = find_option(argc, argv, "--seed"))    options.seed = (unsigned)strtoul(value, nullptr, 10);
+    if (const char* value = find_option(argc, argv, "--balls"))   options.balls = atoi(value);
+    if (const char* value = find_option(argc, argv, "--threads")) options.threads = (unsigned)std::max(1, atoi(value));
+    if (const char* value = find_option(argc, argv, "--kernel"))
+    {
+        if (strcmp(value, "scalar") == 0)    options.kernel = MatchBatch::KERNEL_SCALAR;
+        else if (strcmp(value, "sse2") == 0) options.kernel = MatchBatch::KERNEL_SSE2;
+        else if (strcmp(value, "avx2") == 0) options.kernel = MatchBatch::KERNEL_AVX2;
+        else std::cerr << "unknown --kernel=" << value << ", using " << MatchBatch::get_kernel_name(options.kernel) << '\n';
+
+        const MatchBatch::Kernel best = MatchBatch::best_kernel();
+        if (options.kernel > best)
+        {
+            std::cerr << "this CPU can't run the " << MatchBatch::get_kernel_name(options.kernel)
+                      << " kernel, using " << MatchBatch::get_kernel_name(best) << '\n';
+            options.kernel = best;
+        }
+    }
+    options.batch = has_flag(argc, argv, "--batch");
+
+    if (options.matches < 1) options.matches = 1;
+    if (options.fixed_dt <= 0.0f) options.fixed_dt = DEFAULT_FIXED_DT;
+
+    return options;
+}
+
+bool headless_requested(int argc, char* argv[])
+{
+    return has_flag(argc, argv, "--headless");
+}
+
+// Moves a paddle towards the first ball once it is heading its way and within
+// reaction distance
+static float bot_direction(const GameState& state, const glm::vec3& paddle_position, float reaction_distance)
+{
+    float ball_x = state.balls.x[0],
+        ball_y = state.balls.y[0];
+
+    float ball_distance = fabs(ball_x - paddle_position.x);
+    bool approaching = (ball_x - paddle_position.x) * state.balls.movement_x[0] < 0.0f;
+    if (not approaching or ball_distance > reaction_distance) return 0.0f;
+
+    float offset = ball_y - paddle_position.y;
+    if (offset > g_paddle_height / 4.0f) return 1.0f;
+    if (offset < -g_paddle_height / 4.0f) return -1.0f;
+    return 0.0f;
+}
+
+// Plays a recorded log back as fast as possible, repeat times, checking the
+// final state against the recording each time
+static int run_replay(const char* filepath, int repeat, JobSystem& jobs)
+{
+    InputReplay replay;
+    if (not replay.load(filepath))
+    {
+        std::cout << "Unable to load replay " << filepath << '\n';
+        return 1;
+    }
+
+    bool all_match = true;
+    long long total_steps = 0;
+    uint64_t checksum = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (int run = 0; run < repeat; run++)
+    {
+        GameState state;
+        state.jobs = &jobs;
+        double accumulator = 0.0;
+        InputFrame frame;
+
+        replay.rewind();
+        while (replay.next(frame))
+        {
+            total_steps += advance(state, frame.input, accumulator, frame.frame_time, replay.get_fixed_timestep(),
+                step_directions_hook(frame));
+        }
+
+        checksum = state_checksum(state);
+        if (replay.has_checksum() and checksum != replay.get_final_checksum()) all_match = false;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (seconds <= 0.0) seconds = 1e-9;
+
+    const char* verdict = not replay.has_checksum() ? "not recorded" : all_match ? "matches" : "DIFFERS";
+
+    std::cout << "replay:          " << filepath << '\n'
+              << "runs:            " << repeat << '\n'
+              << "threads:         " << jobs.get_thread_count() << '\n'
+              << "frames:          " << replay.get_frame_count() << '\n'
+              << "fixed dt:        " << replay.get_fixed_timestep() << " s\n"
+              << "steps:           " << total_steps << '\n'
+              << "final checksum:  " << std::hex << checksum << std::dec << " (" << verdict << ")\n"
+              << "wall time:       " << seconds << " s\n"
+              << "frames/sec:      " << replay.get_frame_count() * (double)repeat / seconds << '\n'
+              << "steps/sec:       " << total_steps / seconds << '\n';
+
+    return all_match ? 0 : 1;
+}
+
+// Plays every match at once through MatchBatch. Reaction distances are drawn
+// in the same order as the match-by-match loop, so both report the same wins
+static int run_batch(const HeadlessOptions& options, JobSystem& jobs)
+{
+    if (options.balls != 1)
+    {
+        std::cout << "--batch plays one ball per match\n";
+        return 1;
+    }
+
+    std::mt19937 rng(options.seed);
+    std::uniform_real_distribution<float> reaction(MIN_REACTION_DISTANCE, MAX_REACTION_DISTANCE);
+
+    std::vector<float> red_reaction_distances(options.matches),
+        blue_reaction_distances(options.matches);
+    for (int match = 0; match < options.matches; match++)
+    {
+        red_reaction_distances[match] = reaction(rng);
+        blue_reaction_distances[match] = reaction(rng);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    MatchBatch batch;
+    batch.reset(red_reaction_distances, blue_reaction_distances);
+    long long total_steps = batch.run(options.fixed_dt, MAX_MATCH_SECONDS, options.kernel, &jobs);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (seconds <= 0.0) seconds = 1e-9;
+
+    int outcomes[4] = { 0, 0, 0, 0 };
+    for (size_t match = 0; match < batch.get_match_count(); match++) outcomes[batch.get_outcome(match)]++;
+
+    std::cout << "matches:         " << options.matches << '\n'
+              << "kernel:          " << MatchBatch::get_kernel_name(options.kernel) << '\n'
+              << "threads:         " << jobs.get_thread_count() << '\n'
+              << "fixed dt:        " << options.fixed_dt << " s\n"
+              << "steps:           " << total_steps << '\n'
+              << "dark side wins:  " << outcomes[MatchBatch::DARK_SIDE_WON] << '\n'
+              << "light side wins: " << outcomes[MatchBatch::LIGHT_SIDE_WON] << '\n'
+              << "unfinished:      " << outcomes[MatchBatch::TIMED_OUT] << '\n'
+              << "wall time:       " << seconds << " s\n"
+              << "matches/sec:     " << options.matches / seconds << '\n'
+              << "steps/sec:       " << total_steps / seconds << '\n';
+
+    return 0;
+}
+
+// Counts overlapping, approaching pairs the slow way, as a reference for
+// the grid
+static size_t brute_force_contacts(const BallPool& balls)
+{
+    size_t contacts = 0;
+    for (size_t i = 0; i < balls.size(); i++)
+    {
+        for (size_t j = i + 1; j < balls.size(); j++)
+        {
+            float offset_x = balls.x[j] - balls.x[i],
+                offset_y = balls.y[j] - balls.y[i];
+            float distance_squared = offset_x * offset_x + offset_y * offset_y;
+            float closing = (balls.movement_x[j] - balls.movement_x[i]) * offset_x + (balls.movement_y[j] - balls.movement_y[i]) * offset_y;
+            if (distance_squared < g_ball_width * g_ball_width and distance_squared > 0.0f and closing < 0.0f) contacts++;
+        }
+    }
+    return contacts;
+}
+
+// Times the ball-ball collision pass on 1k, 10k and 100k balls scattered over
+// the court, and checks the grid against brute force where that is quick.
+// Fails on any difference unless max_candidates asks for the capped mode,
+// which is expected to miss contacts.
+static int run_grid_bench(unsigned seed, int max_candidates, JobSystem& jobs)
+{
+    const size_t BALL_COUNTS[] = { 1000, 10000, 100000 };
+    constexpr size_t BRUTE_FORCE_LIMIT = 10000;
+
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> court_x(-4.0f, 4.0f), court_y(-g_paddles_height_limit, g_paddles_height_limit),
+        direction(-1.0f, 1.0f);
+
+    std::cout << "threads:         " << jobs.get_thread_count() << '\n'
+              << "max candidates:  ";
+    if (max_candidates > 0) std::cout << max_candidates << " (contacts will be missed)\n\n";
+    else std::cout << "unlimited\n\n";
+
+    bool mismatch = false;
+
+    for (size_t ball_count : BALL_COUNTS)
+    {
+        BallPool balls;
+        balls.resize(ball_count);
+        for (size_t i = 0; i < ball_count; i++)
+        {
+            balls.x[i] = court_x(rng);
+            balls.y[i] = court_y(rng);
+            balls.movement_x[i] = direction(rng);
+            balls.movement_y[i] = direction(rng);
+            balls.alive[i] = 1;
+        }
+        const std::vector<float> movement_x = balls.movement_x, movement_y = balls.movement_y;
+
+        size_t reference_contacts = ball_count <= BRUTE_FORCE_LIMIT ? brute_force_contacts(balls) : 0;
+
+        BallGrid grid;
+        const int ticks = (int)std::max<size_t>(5, 2000000 / ball_count);
+        double build_seconds = 0.0, collide_seconds = 0.0;
+        BallCollisionStats stats;
+
+        for (int tick = 0; tick < ticks; tick++)
+        {
+            balls.movement_x = movement_x;
+            balls.movement_y = movement_y;
+
+            auto start = std::chrono::steady_clock::now();
+            grid.build(balls.x.data(), balls.y.data(), balls.alive.data(), ball_count, g_ball_width);
+            auto built = std::chrono::steady_clock::now();
+            stats = collide_balls(balls, grid, &jobs, max_candidates); // rebuilds the grid itself
+            auto collided = std::chrono::steady_clock::now();
+
+            build_seconds += std::chrono::duration<double>(built - start).count();
+            collide_seconds += std::chrono::duration<double>(collided - built).count();
+        }
+
+        std::cout << "balls:           " << ball_count << '\n'
+                  << "grid build:      " << build_seconds * 1000.0 / ticks << " ms/tick\n"
+                  << "build + collide: " << collide_seconds * 1000.0 / ticks << " ms/tick\n"
+                  << "candidates:      " << stats.candidates << " per tick\n"
+                  << "capped balls:    " << stats.capped_balls << " per tick\n"
+                  << "contacts:        " << stats.contacts << " per tick";
+        if (ball_count <= BRUTE_FORCE_LIMIT) std::cout << " (brute force: " << reference_contacts << ")";
+        std::cout << "\n\n";
+
+        if (ball_count <= BRUTE_FORCE_LIMIT and stats.contacts != reference_contacts)
+        {
+            std::cerr << "WARNING: grid found " << stats.contacts << " contacts at " << ball_count
+                      << " balls, brute force " << reference_contacts << '\n';
+            mismatch = true;
+        }
+    }
+
+    return mismatch and max_candidates <= 0 ? 1 : 0;
+}
+
+int run_headless(int argc, char* argv[])
+{
+    HeadlessOptions options = parse_options(argc, argv);
+
+    JobSystem jobs;
+    jobs.start(options.threads - 1);
+
+    if (const char* filepath = find_option(argc, argv, "--replay"))
+    {
+        const char* repeat = find_option(argc, argv, "--repeat");
+        return run_replay(filepath, repeat ? std::max(1, atoi(repeat)) : 1, jobs);
+    }
+
+    if (options.batch) return run_batch(options, jobs);
+    if (has_flag(argc, argv, "--bench-grid"))
+    {
+        const char* max_candidates = find_option(argc, argv, "--max-candidates");
+        return run_grid_bench(options.seed, max_candidates ? atoi(max_candidates) : 0, jobs);
+    }
+
+    std::mt19937 rng(options.seed);
+    std::uniform_real_distribution<float> reaction(MIN_REACTION_DISTANCE, MAX_REACTION_DISTANCE);
+
+    int dark_side_wins = 0,
+        light_side_wins = 0,
+        unfinished = 0;
+    long long total_steps = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (int match = 0; match < options.matches; match++)
+    {
+        GameState state;
+        state.jobs = &jobs;
+        float red_reaction_distance = reaction(rng),
+            blue_reaction_distance = reaction(rng);
+
+        SimInput input;
+        input.ball_count_request = options.balls;
+        input.start_requested = true;
+        simulate(state, input, options.fixed_dt);
+        total_steps++;
+
+        input = SimInput();
+        while (state.start_game and state.elapsed_time < MAX_MATCH_SECONDS)
+        {
+            input.red_paddle_direction = bot_direction(state, state.red_paddle_position, red_reaction_distance);
+            input.blue_paddle_direction = bot_direction(state, state.blue_paddle_position, blue_reaction_distance);
+            simulate(state, input, options.fixed_dt);
+            total_steps++;
+        }
+
+        if (state.dark_side_won)       dark_side_wins++;
+        else if (state.light_side_won) light_side_wins++;
+        else                           unfinished++;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (seconds <= 0.0) seconds = 1e-9;
+
+    std::cout << "matches:         " << options.matches << '\n'
+              << "fixed dt:        " << options.fixed_dt << " s\n"
+              << "balls:           " << options.balls << '\n'
+              << "threads:         " << jobs.get_thread_count() << '\n'
+              << "steps:           " << total_steps << '\n'
+              << "dark side wins:  " << dark_side_wins << '\n'
+              << "light side wins: " << light_side_wins << '\n'
+              << "unfinished:      " << unfinished << '\n'
+              << "wall time:       " << seconds << " s\n"
+              << "matches/sec:     " << options.matches / seconds << '\n'
+              << "steps/sec:       " << total_steps / seconds << '\n';
+
+    return 0;
+}
@@ -0,0 +1,22 @@
+/**
+ * @file Headless.h
+ * @brief Runs whole matches of the simulation with no window, GL context or
+ * rendering, at a fixed step chosen on the command line.
+ *
+ * Usage: --headless [--matches=N] [--dt=SECONDS] [--seed=N] [--balls=N]
+ *        --headless --batch [--matches=N] [--dt=SECONDS] [--seed=N] [--kernel=scalar|sse2|avx2]
+ *        --headless --replay=LOG [--repeat=N]
+ *        --headless --bench-grid [--seed=N] [--max-candidates=N]
+ *
+ * Every mode takes --threads=N (default: one per hardware thread); results
+ * don't depend on it.
+ */
+
+#pragma once
+
+// Returns true when argv asks for the headless runner
+bool headless_requested(int argc, char* argv[]);
+
+// Plays the requested number of matches and prints matches/sec; returns the
+// process exit code
+int run_headless(int argc, char* argv[]);
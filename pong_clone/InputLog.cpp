@@ -0,0 +1,199 @@
+/**
+ * @file InputLog.cpp
+ * @brief Values are written in host byte order, which is little-endian on
+ * every platform the game builds for.
+ */
+#include <cstring>
+#include "InputLog.h"
+
+constexpr uint32_t INPUT_LOG_MAGIC = 0x474C5050; // "PPLG"
+constexpr uint32_t INPUT_LOG_VERSION = 3;
+
+enum InputFlags : uint8_t
+{
+    RED_UP = 1 << 0,
+    RED_DOWN = 1 << 1,
+    BLUE_UP = 1 << 2,
+    BLUE_DOWN = 1 << 3,
+    TOGGLE_SINGLE_PLAYER = 1 << 4,
+    START_REQUESTED = 1 << 5,
+    HAS_BALL_COUNT = 1 << 6,
+    TOGGLE_BALL_COLLISIONS = 1 << 7,
+
+    // Never a valid combination of the above (a paddle can't move both
+    // ways); marks the trailer
+    TRAILER = 0xFF
+};
+
+struct InputLogHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    float fixed_timestep;
+    uint32_t reserved;
+};
+
+static uint8_t direction_flags(float direction, uint8_t up, uint8_t down)
+{
+    if (direction > 0.0f) return up;
+    if (direction < 0.0f) return down;
+    return 0;
+}
+
+static float flags_direction(uint8_t flags, uint8_t up, uint8_t down)
+{
+    if (flags & up) return 1.0f;
+    if (flags & down) return -1.0f;
+    return 0.0f;
+}
+
+/* RECORDING */
+
+bool InputRecorder::open(const char* filepath, float fixed_timestep)
+{
+    m_file = fopen(filepath, "wb");
+    if (m_file == NULL) return false;
+
+    InputLogHeader header = { INPUT_LOG_MAGIC, INPUT_LOG_VERSION, fixed_timestep, 0 };
+    fwrite(&header, sizeof(header), 1, m_file);
+    m_frame_count = 0;
+    return true;
+}
+
+void InputRecorder::record(const InputFrame& frame)
+{
+    if (m_file == nullptr) return;
+
+    const SimInput& input = frame.input;
+    uint8_t flags = direction_flags(input.red_paddle_direction, RED_UP, RED_DOWN)
+        | direction_flags(input.blue_paddle_direction, BLUE_UP, BLUE_DOWN);
+    if (input.toggle_single_player)   flags |= TOGGLE_SINGLE_PLAYER;
+    if (input.toggle_ball_collisions) flags |= TOGGLE_BALL_COLLISIONS;
+    if (input.start_requested)        flags |= START_REQUESTED;
+    if (input.ball_count_request)     flags |= HAS_BALL_COUNT;
+
+    fwrite(&flags, 1, 1, m_file);
+    fwrite(&frame.frame_time, sizeof(frame.frame_time), 1, m_file);
+    if (flags & HAS_BALL_COUNT)
+    {
+        int32_t ball_count = input.ball_count_request;
+        fwrite(&ball_count, sizeof(ball_count), 1, m_file);
+    }
+
+    uint16_t step_count = (uint16_t)(frame.step_directions.size() / 2);
+    fwrite(&step_count, sizeof(step_count), 1, m_file);
+    fwrite(frame.step_directions.data(), sizeof(float), step_count * 2, m_file);
+
+    m_frame_count++;
+}
+
+void InputRecorder::close(uint64_t final_checksum)
+{
+    if (m_file == nullptr) return;
+
+    uint8_t marker = TRAILER;
+    fwrite(&marker, 1, 1, m_file);
+    fwrite(&m_frame_count, sizeof(m_frame_count), 1, m_file);
+    fwrite(&final_checksum, sizeof(final_checksum), 1, m_file);
+
+    fclose(m_file);
+    m_file = nullptr;
+}
+
+InputRecorder::~InputRecorder()
+{
+    if (m_file != nullptr) fclose(m_file);
+}
+
+/* REPLAY */
+
+bool InputReplay::load(const char* filepath)
+{
+    m_frames.clear();
+    m_next_frame = 0;
+    m_fixed_timestep = 0.0f;
+    m_has_checksum = false;
+
+    FILE* file = fopen(filepath, "rb");
+    if (file == NULL) return false;
+
+    std::vector<unsigned char> data;
+    unsigned char chunk[1 << 16];
+    size_t read;
+    while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0) data.insert(data.end(), chunk, chunk + read);
+    fclose(file);
+
+    InputLogHeader header;
+    if (data.size() < sizeof(header)) return false;
+    memcpy(&header, data.data(), sizeof(header));
+    if (header.magic != INPUT_LOG_MAGIC or header.version != INPUT_LOG_VERSION or header.fixed_timestep <= 0.0f) return false;
+
+    const unsigned char* cursor = data.data() + sizeof(header);
+    const unsigned char* end = data.data() + data.size();
+
+    while (cursor < end)
+    {
+        uint8_t flags = *cursor++;
+
+        if (flags == TRAILER)
+        {
+            uint64_t frame_count;
+            if (end - cursor < (ptrdiff_t)(sizeof(frame_count) + sizeof(m_final_checksum))) return false;
+            memcpy(&frame_count, cursor, sizeof(frame_count));
+            memcpy(&m_final_checksum, cursor + sizeof(frame_count), sizeof(m_final_checksum));
+            if (frame_count != m_frames.size()) return false;
+            m_has_checksum = true;
+            break;
+        }
+
+        InputFrame frame;
+        size_t frame_size = sizeof(frame.frame_time) + (flags & HAS_BALL_COUNT ? sizeof(int32_t) : 0) + sizeof(uint16_t);
+        if ((size_t)(end - cursor) < frame_size) break; // the recording was cut off mid-frame
+
+        memcpy(&frame.frame_time, cursor, sizeof(frame.frame_time));
+        cursor += sizeof(frame.frame_time);
+
+        frame.input.red_paddle_direction = flags_direction(flags, RED_UP, RED_DOWN);
+        frame.input.blue_paddle_direction = flags_direction(flags, BLUE_UP, BLUE_DOWN);
+        frame.input.toggle_single_player = (flags & TOGGLE_SINGLE_PLAYER) != 0;
+        frame.input.start_requested = (flags & START_REQUESTED) != 0;
+        frame.input.toggle_ball_collisions = (flags & TOGGLE_BALL_COLLISIONS) != 0;
+        if (flags & HAS_BALL_COUNT)
+        {
+            int32_t ball_count;
+            memcpy(&ball_count, cursor, sizeof(ball_count));
+            cursor += sizeof(ball_count);
+            frame.input.ball_count_request = ball_count;
+        }
+
+        uint16_t step_count;
+        memcpy(&step_count, cursor, sizeof(step_count));
+        cursor += sizeof(step_count);
+        if ((size_t)(end - cursor) < step_count * 2 * sizeof(float)) break;
+        frame.step_directions.resize(step_count * 2);
+        memcpy(frame.step_directions.data(), cursor, step_count * 2 * sizeof(float));
+        cursor += step_count * 2 * sizeof(float);
+
+        m_frames.push_back(frame);
+    }
+
+    m_fixed_timestep = header.fixed_timestep;
+    return true;
+}
+
+bool InputReplay::next(InputFrame& frame)
+{
+    if (m_next_frame >= m_frames.size()) return false;
+    frame = m_frames[m_next_frame++];
+    return true;
+}
+
+StepInputHook step_directions_hook(const InputFrame& frame)
+{
+    return [&frame](int step, SimInput& input)
+    {
+        if ((size_t)step * 2 + 1 >= frame.step_directions.size()) return;
+        input.red_paddle_direction = frame.step_directions[step * 2];
+        input.blue_paddle_direction = frame.step_directions[step * 2 + 1];
+    };
+}
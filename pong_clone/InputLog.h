@@ -0,0 +1,79 @@
+/**
+ * @file InputLog.h
+ * @brief Records the input and frame time of every frame to a compact binary
+ * log and plays it back. The simulation is deterministic, so replaying a log
+ * through advance() reproduces the recorded game exactly, which makes logs
+ * usable both as bug repros and as benchmark workloads.
+ *
+ * Layout (little-endian): a header with the fixed timestep, then per frame a
+ * flags byte, the frame time as a double, when flagged the requested ball
+ * count, and a 16-bit count of per-step paddle direction pairs followed by
+ * the pairs as floats. close() appends the frame count and the final state
+ * checksum.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "Simulation.h"
+
+struct InputFrame
+{
+    double frame_time = 0.0; // seconds added to the accumulator, already clamped
+    SimInput input;
+
+    // Red then blue direction for each step of the frame, when input was
+    // integrated per step; empty when every step used input's directions
+    std::vector<float> step_directions;
+};
+
+// Gives each step of frame the paddle directions it was recorded with
+StepInputHook step_directions_hook(const InputFrame& frame);
+
+class InputRecorder
+{
+private:
+    FILE* m_file = nullptr;
+    uint64_t m_frame_count = 0;
+
+public:
+    bool open(const char* filepath, float fixed_timestep);
+
+    // Writes the trailer; a log whose recorder was never closed still
+    // replays, it just can't be verified
+    void close(uint64_t final_checksum);
+    ~InputRecorder();
+
+    void record(const InputFrame& frame);
+
+    bool is_open() const { return m_file != nullptr; };
+    uint64_t get_frame_count() const { return m_frame_count; };
+};
+
+class InputReplay
+{
+private:
+    std::vector<InputFrame> m_frames;
+    size_t m_next_frame = 0;
+
+    float m_fixed_timestep = 0.0f;
+    bool m_has_checksum = false;
+    uint64_t m_final_checksum = 0;
+
+public:
+    bool load(const char* filepath);
+
+    // Returns false once every frame has been handed out
+    bool next(InputFrame& frame);
+    void rewind() { m_next_frame = 0; };
+
+    bool is_loaded() const { return m_fixed_timestep > 0.0f; };
+    size_t get_frame_count() const { return m_frames.size(); };
+    float get_fixed_timestep() const { return m_fixed_timestep; };
+
+    // Only meaningful when has_checksum(); a recording cut short has none
+    bool has_checksum() const { return m_has_checksum; };
+    uint64_t get_final_checksum() const { return m_final_checksum; };
+};
@@ -0,0 +1,149 @@
+/**
+ * @file JobSystem.cpp
+ * @brief Every deque has its own mutex. A thief copies the tasks it takes
+ * out before touching its own deque, so no thread ever holds two locks.
+ */
+#include <algorithm>
+#include "JobSystem.h"
+
+unsigned JobSystem::default_worker_count()
+{
+    unsigned hardware_threads = std::thread::hardware_concurrency();
+    return hardware_threads > 1 ? hardware_threads - 1 : 0;
+}
+
+void JobSystem::start(unsigned worker_count)
+{
+    stop();
+
+    m_stopping = false;
+    m_queues.clear();
+    for (unsigned i = 0; i <= worker_count; i++) m_queues.push_back(std::unique_ptr<Queue>(new Queue()));
+
+    for (unsigned i = 1; i <= worker_count; i++)
+    {
+        m_threads.emplace_back(&JobSystem::worker_loop, this, (size_t)i);
+    }
+}
+
+void JobSystem::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_wake_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+
+    for (std::thread& thread : m_threads) thread.join();
+    m_threads.clear();
+}
+
+bool JobSystem::pop(size_t queue_index, Task& task)
+{
+    Queue& queue = *m_queues[queue_index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) return false;
+
+    task = queue.tasks.back();
+    queue.tasks.pop_back();
+    return true;
+}
+
+bool JobSystem::steal(size_t queue_index, Task& task)
+{
+    const size_t queue_count = m_queues.size();
+    for (size_t offset = 1; offset < queue_count; offset++)
+    {
+        Queue& victim = *m_queues[(queue_index + offset) % queue_count];
+
+        std::vector<Task> stolen;
+        {
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            size_t take = (victim.tasks.size() + 1) / 2;
+            stolen.assign(victim.tasks.begin(), victim.tasks.begin() + take);
+            victim.tasks.erase(victim.tasks.begin(), victim.tasks.begin() + take);
+        }
+        if (stolen.empty()) continue;
+
+        // Run the first and keep the rest where others can steal them again
+        task = stolen.front();
+        if (stolen.size() > 1)
+        {
+            Queue& own = *m_queues[queue_index];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            own.tasks.insert(own.tasks.end(), stolen.begin() + 1, stolen.end());
+        }
+        return true;
+    }
+    return false;
+}
+
+bool JobSystem::find_task(size_t queue_index, Task& task)
+{
+    return pop(queue_index, task) or steal(queue_index, task);
+}
+
+void JobSystem::run(Task& task)
+{
+    m_queued_tasks--;
+    (*task.body)(task.begin, task.end);
+    task.remaining->fetch_sub(1, std::memory_order_release);
+}
+
+void JobSystem::worker_loop(size_t queue_index)
+{
+    while (true)
+    {
+        Task task;
+        if (find_task(queue_index, task))
+        {
+            run(task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_wake_mutex);
+        m_wake.wait(lock, [this] { return m_stopping or m_queued_tasks > 0; });
+        if (m_stopping) return;
+    }
+}
+
+void JobSystem::parallel_for(size_t count, size_t grain, const RangeBody& body)
+{
+    if (count == 0) return;
+    if (grain == 0) grain = 1;
+
+    const size_t chunk_count = (count + grain - 1) / grain;
+    if (m_threads.empty() or chunk_count == 1)
+    {
+        for (size_t begin = 0; begin < count; begin += grain) body(begin, std::min(begin + grain, count));
+        return;
+    }
+
+    std::atomic<size_t> remaining{ chunk_count };
+
+    // Counted before they are published: run() decrements as soon as a task
+    // is taken, which must never come first
+    {
+        std::lock_guard<std::mutex> lock(m_wake_mutex);
+        m_queued_tasks += chunk_count;
+    }
+    {
+        // Pushed last-first so the caller, popping from the back, starts at
+        // the beginning of the range while thieves take from the end
+        Queue& own = *m_queues[0];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        for (size_t chunk = chunk_count; chunk-- > 0;)
+        {
+            Task task = { &body, chunk * grain, std::min((chunk + 1) * grain, count), &remaining };
+            own.tasks.push_back(task);
+        }
+    }
+    m_wake.notify_all();
+
+    while (remaining.load(std::memory_order_acquire) > 0)
+    {
+        Task task;
+        if (find_task(0, task)) run(task);
+        else std::this_thread::yield();
+    }
+}
@@ -0,0 +1,76 @@
+/**
+ * @file JobSystem.h
+ * @brief JobSystem class declaration. A small work-stealing thread pool: each
+ * thread owns a deque of tasks, works from its back, and when empty steals
+ * the front half of another thread's deque. The thread that calls
+ * parallel_for() works alongside the pool until the loop is done.
+ *
+ * parallel_for() cuts a range into chunks that depend only on its count and
+ * grain, never on the number of threads, so a body that writes only its own
+ * indices gives the same result on 1 thread or 16.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobSystem
+{
+public:
+    typedef std::function<void(size_t begin, size_t end)> RangeBody;
+
+private:
+    struct Task
+    {
+        const RangeBody* body;
+        size_t begin, end;
+        std::atomic<size_t>* remaining;
+    };
+
+    // Queue 0 belongs to the thread calling parallel_for(); the rest to
+    // the pool's own threads
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::vector<std::thread> m_threads;
+
+    std::atomic<size_t> m_queued_tasks{ 0 };
+    std::mutex m_wake_mutex;
+    std::condition_variable m_wake;
+    bool m_stopping = false;
+
+    bool pop(size_t queue_index, Task& task);
+    bool steal(size_t queue_index, Task& task);
+    bool find_task(size_t queue_index, Task& task);
+    void run(Task& task);
+    void worker_loop(size_t queue_index);
+
+public:
+    // worker_count threads on top of the caller's; 0 runs everything on the
+    // calling thread
+    void start(unsigned worker_count);
+    void stop();
+    ~JobSystem() { stop(); }
+
+    // Runs body over [0, count) in chunks of at most grain indices and
+    // returns once every chunk is done. Must be called from the thread that
+    // started the system, and not from inside a body.
+    void parallel_for(size_t count, size_t grain, const RangeBody& body);
+
+    unsigned get_thread_count() const { return (unsigned)m_threads.size() + 1; };
+
+    // One worker per hardware thread besides the caller's
+    static unsigned default_worker_count();
+};
@@ -0,0 +1,569 @@
+/**
+ * @file MatchBatch.cpp
+ * @brief Each kernel loads a block of lanes into registers, runs up to
+ * STEPS_PER_PASS steps on them, and stores them back, leaving a block early
+ * once all of its matches are decided. Lanes whose ball may touch a paddle or
+ * wall during a step are swept one at a time with sweep_ball(). Between
+ * passes finished matches are compacted out so later passes only touch lanes
+ * still in play.
+ *
+ * Bots follow the same rule as the headless runner: track the ball only while
+ * it approaches and is within reaction distance, with a dead zone of a
+ * quarter paddle height.
+ */
+#include <algorithm>
+#include <cmath>
+#include "JobSystem.h"
+#include "MatchBatch.h"
+#include "Simulation.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    #define MATCH_BATCH_X86 1
+    #include <immintrin.h>
+    #ifdef _MSC_VER
+        #include <intrin.h>
+        #define TARGET_AVX2
+    #else
+        #define TARGET_AVX2 __attribute__((target("avx2")))
+    #endif
+#endif
+
+constexpr float RED_X = INIT_POS_RED_PADDLE.x,
+BLUE_X = INIT_POS_BLUE_PADDLE.x;
+
+constexpr float BOT_DEAD_ZONE = g_paddle_height / 4.0f;
+
+constexpr float REACH_X = (g_paddle_width + g_ball_width) / 2.0f,
+REACH_Y = (g_paddle_height + g_ball_width) / 2.0f;
+
+// Pointers to the lane arrays, handed to whichever kernel runs
+struct Lanes
+{
+    float *red_y, *blue_y, *ball_x, *ball_y, *movement_x, *movement_y, *ball_speed, *elapsed_time;
+    const float *red_reaction, *blue_reaction;
+    int32_t *outcome, *steps;
+};
+
+/* SCALAR */
+
+static float bot_direction(float ball_x, float ball_y, float movement_x, float paddle_x, float paddle_y, float reaction_distance)
+{
+    float offset_x = ball_x - paddle_x;
+    if (not (offset_x * movement_x < 0.0f) or fabsf(offset_x) > reaction_distance) return 0.0f;
+
+    float offset_y = ball_y - paddle_y;
+    if (offset_y > BOT_DEAD_ZONE) return 1.0f;
+    if (offset_y < -BOT_DEAD_ZONE) return -1.0f;
+    return 0.0f;
+}
+
+// The same test simulate() uses to pick the balls it sweeps. Sweeping a ball
+// that turns out to hit nothing gives the unswept result, so this only has
+// to be conservative.
+static bool needs_sweep(float ball_x, float ball_y, float new_ball_x, float new_ball_y, float red_y, float blue_y)
+{
+    const float low_x = std::min(ball_x, new_ball_x), high_x = std::max(ball_x, new_ball_x),
+        low_y = std::min(ball_y, new_ball_y), high_y = std::max(ball_y, new_ball_y);
+    const bool near_red = low_x < RED_X + REACH_X and high_x > RED_X - REACH_X and low_y < red_y + REACH_Y and high_y > red_y - REACH_Y;
+    const bool near_blue = low_x < BLUE_X + REACH_X and high_x > BLUE_X - REACH_X and low_y < blue_y + REACH_Y and high_y > blue_y - REACH_Y;
+    return near_red or near_blue or new_ball_y > g_paddles_height_limit or new_ball_y < -g_paddles_height_limit;
+}
+
+// Sweeps the flagged lanes of a register block one by one; blocks hit a
+// paddle or wall on only a small fraction of steps
+static void sweep_lanes(int flagged, int width, const float* ball_x, const float* ball_y, const float* ball_step,
+    const float* red_y, const float* blue_y, float* new_ball_x, float* new_ball_y, float* movement_x, float* movement_y)
+{
+    for (int lane = 0; lane < width; lane++)
+    {
+        if (not (flagged & (1 << lane))) continue;
+        new_ball_x[lane] = ball_x[lane];
+        new_ball_y[lane] = ball_y[lane];
+        sweep_ball(new_ball_x[lane], new_ball_y[lane], movement_x[lane], movement_y[lane], ball_step[lane],
+            RED_X, red_y[lane], BLUE_X, blue_y[lane]);
+    }
+}
+
+static void step_scalar(const Lanes& lanes, size_t lane_count, float delta_time, float max_seconds, int steps)
+{
+    const float paddle_step = g_paddle_speed * delta_time;
+
+    for (size_t i = 0; i < lane_count; i++)
+    {
+        for (int step = 0; step < steps and lanes.outcome[i] == MatchBatch::RUNNING; step++)
+        {
+            const float ball_x = lanes.ball_x[i],
+                ball_y = lanes.ball_y[i];
+
+            float elapsed_time = lanes.elapsed_time[i] + delta_time;
+
+            float red_direction = bot_direction(ball_x, ball_y, lanes.movement_x[i], RED_X, lanes.red_y[i], lanes.red_reaction[i]);
+            float blue_direction = bot_direction(ball_x, ball_y, lanes.movement_x[i], BLUE_X, lanes.blue_y[i], lanes.blue_reaction[i]);
+
+            float ball_speed = lanes.ball_speed[i] + g_ball_speed_growth * elapsed_time * delta_time;
+
+            float red_y = std::min(std::max(lanes.red_y[i] + red_direction * paddle_step, -g_paddles_height_limit), g_paddles_height_limit);
+            float blue_y = std::min(std::max(lanes.blue_y[i] + blue_direction * paddle_step, -g_paddles_height_limit), g_paddles_height_limit);
+
+            bool hit_red = fabsf(ball_x - RED_X) < REACH_X and fabsf(ball_y - red_y) < REACH_Y;
+            bool hit_blue = fabsf(ball_x - BLUE_X) < REACH_X and fabsf(ball_y - blue_y) < REACH_Y;
+
+            float movement_x = lanes.movement_x[i];
+            if (hit_red)  movement_x = fabsf(movement_x);
+            if (hit_blue) movement_x = -fabsf(movement_x);
+
+            float movement_y = lanes.movement_y[i];
+            if (ball_y > g_paddles_height_limit)  movement_y = -fabsf(movement_y);
+            if (ball_y < -g_paddles_height_limit) movement_y = fabsf(movement_y);
+
+            const float ball_step = ball_speed * delta_time;
+            float new_ball_x = ball_x + movement_x * ball_step,
+                new_ball_y = ball_y + movement_y * ball_step;
+            if (needs_sweep(ball_x, ball_y, new_ball_x, new_ball_y, red_y, blue_y))
+            {
+                new_ball_x = ball_x;
+                new_ball_y = ball_y;
+                sweep_ball(new_ball_x, new_ball_y, movement_x, movement_y, ball_step, RED_X, red_y, BLUE_X, blue_y);
+            }
+
+            lanes.ball_x[i] = new_ball_x;
+            lanes.ball_y[i] = new_ball_y;
+            lanes.movement_x[i] = movement_x;
+            lanes.movement_y[i] = movement_y;
+            lanes.red_y[i] = red_y;
+            lanes.blue_y[i] = blue_y;
+            lanes.ball_speed[i] = ball_speed;
+            lanes.elapsed_time[i] = elapsed_time;
+            lanes.steps[i]++;
+
+            if (ball_x > g_out_of_bounds_x)       lanes.outcome[i] = MatchBatch::DARK_SIDE_WON;
+            else if (ball_x < -g_out_of_bounds_x) lanes.outcome[i] = MatchBatch::LIGHT_SIDE_WON;
+            else if (elapsed_time >= max_seconds) lanes.outcome[i] = MatchBatch::TIMED_OUT;
+        }
+    }
+}
+
+#ifdef MATCH_BATCH_X86
+
+/* SSE2 */
+
+static inline __m128 select_sse2(__m128 mask, __m128 if_true, __m128 if_false)
+{
+    return _mm_or_ps(_mm_and_ps(mask, if_true), _mm_andnot_ps(mask, if_false));
+}
+
+static inline __m128 bot_direction_sse2(__m128 ball_x, __m128 ball_y, __m128 movement_x, __m128 paddle_x, __m128 paddle_y, __m128 reaction_distance)
+{
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), sign = _mm_set1_ps(-0.0f);
+    const __m128 dead_zone = _mm_set1_ps(BOT_DEAD_ZONE), negative_dead_zone = _mm_set1_ps(-BOT_DEAD_ZONE);
+
+    __m128 offset_x = _mm_sub_ps(ball_x, paddle_x);
+    __m128 reacting = _mm_and_ps(_mm_cmplt_ps(_mm_mul_ps(offset_x, movement_x), zero),
+        _mm_cmple_ps(_mm_andnot_ps(sign, offset_x), reaction_distance));
+
+    __m128 offset_y = _mm_sub_ps(ball_y, paddle_y);
+    __m128 direction = _mm_sub_ps(_mm_and_ps(_mm_cmpgt_ps(offset_y, dead_zone), one),
+        _mm_and_ps(_mm_cmplt_ps(offset_y, negative_dead_zone), one));
+    return _mm_and_ps(reacting, direction);
+}
+
+static void step_sse2(const Lanes& lanes, size_t lane_count, float delta_time, float max_seconds, int steps)
+{
+    const __m128 dt = _mm_set1_ps(delta_time), paddle_step = _mm_set1_ps(g_paddle_speed * delta_time),
+        growth = _mm_set1_ps(g_ball_speed_growth), max_time = _mm_set1_ps(max_seconds),
+        limit = _mm_set1_ps(g_paddles_height_limit), negative_limit = _mm_set1_ps(-g_paddles_height_limit),
+        out_x = _mm_set1_ps(g_out_of_bounds_x), negative_out_x = _mm_set1_ps(-g_out_of_bounds_x),
+        reach_x = _mm_set1_ps(REACH_X), reach_y = _mm_set1_ps(REACH_Y),
+        red_x = _mm_set1_ps(RED_X), blue_x = _mm_set1_ps(BLUE_X), sign = _mm_set1_ps(-0.0f);
+    const __m128i running_outcome = _mm_set1_epi32(MatchBatch::RUNNING),
+        dark_side_won = _mm_set1_epi32(MatchBatch::DARK_SIDE_WON),
+        light_side_won = _mm_set1_epi32(MatchBatch::LIGHT_SIDE_WON),
+        timed_out = _mm_set1_epi32(MatchBatch::TIMED_OUT);
+
+    for (size_t i = 0; i < lane_count; i += 4)
+    {
+        __m128 ball_x = _mm_loadu_ps(lanes.ball_x + i), ball_y = _mm_loadu_ps(lanes.ball_y + i),
+            movement_x = _mm_loadu_ps(lanes.movement_x + i), movement_y = _mm_loadu_ps(lanes.movement_y + i),
+            red_y = _mm_loadu_ps(lanes.red_y + i), blue_y = _mm_loadu_ps(lanes.blue_y + i),
+            ball_speed = _mm_loadu_ps(lanes.ball_speed + i), elapsed_time = _mm_loadu_ps(lanes.elapsed_time + i);
+        const __m128 red_reaction = _mm_loadu_ps(lanes.red_reaction + i), blue_reaction = _mm_loadu_ps(lanes.blue_reaction + i);
+        __m128i outcome = _mm_loadu_si128((const __m128i*)(lanes.outcome + i)),
+            step_count = _mm_loadu_si128((const __m128i*)(lanes.steps + i));
+
+        for (int step = 0; step < steps; step++)
+        {
+            const __m128i running_int = _mm_cmpeq_epi32(outcome, running_outcome);
+            const __m128 running = _mm_castsi128_ps(running_int);
+            if (_mm_movemask_ps(running) == 0) break;
+
+            const __m128 new_elapsed_time = _mm_add_ps(elapsed_time, dt);
+
+            __m128 red_direction = bot_direction_sse2(ball_x, ball_y, movement_x, red_x, red_y, red_reaction);
+            __m128 blue_direction = bot_direction_sse2(ball_x, ball_y, movement_x, blue_x, blue_y, blue_reaction);
+
+            __m128 new_ball_speed = _mm_add_ps(ball_speed, _mm_mul_ps(_mm_mul_ps(growth, new_elapsed_time), dt));
+
+            __m128 new_red_y = _mm_min_ps(_mm_max_ps(_mm_add_ps(red_y, _mm_mul_ps(red_direction, paddle_step)), negative_limit), limit);
+            __m128 new_blue_y = _mm_min_ps(_mm_max_ps(_mm_add_ps(blue_y, _mm_mul_ps(blue_direction, paddle_step)), negative_limit), limit);
+
+            __m128 hit_red = _mm_and_ps(_mm_cmplt_ps(_mm_andnot_ps(sign, _mm_sub_ps(ball_x, red_x)), reach_x),
+                _mm_cmplt_ps(_mm_andnot_ps(sign, _mm_sub_ps(ball_y, new_red_y)), reach_y));
+            __m128 hit_blue = _mm_and_ps(_mm_cmplt_ps(_mm_andnot_ps(sign, _mm_sub_ps(ball_x, blue_x)), reach_x),
+                _mm_cmplt_ps(_mm_andnot_ps(sign, _mm_sub_ps(ball_y, new_blue_y)), reach_y));
+
+            __m128 abs_movement_x = _mm_andnot_ps(sign, movement_x);
+            __m128 new_movement_x = select_sse2(hit_red, abs_movement_x, movement_x);
+            new_movement_x = select_sse2(hit_blue, _mm_or_ps(sign, new_movement_x), new_movement_x);
+
+            __m128 abs_movement_y = _mm_andnot_ps(sign, movement_y);
+            __m128 new_movement_y = select_sse2(_mm_cmpgt_ps(ball_y, limit), _mm_or_ps(sign, movement_y), movement_y);
+            new_movement_y = select_sse2(_mm_cmplt_ps(ball_y, negative_limit), abs_movement_y, new_movement_y);
+
+            __m128 ball_step = _mm_mul_ps(new_ball_speed, dt);
+            __m128 new_ball_x = _mm_add_ps(ball_x, _mm_mul_ps(new_movement_x, ball_step));
+            __m128 new_ball_y = _mm_add_ps(ball_y, _mm_mul_ps(new_movement_y, ball_step));
+
+            __m128 low_x = _mm_min_ps(ball_x, new_ball_x), high_x = _mm_max_ps(ball_x, new_ball_x),
+                low_y = _mm_min_ps(ball_y, new_ball_y), high_y = _mm_max_ps(ball_y, new_ball_y);
+            __m128 near_red = _mm_and_ps(_mm_and_ps(_mm_cmplt_ps(low_x, _mm_add_ps(red_x, reach_x)), _mm_cmpgt_ps(high_x, _mm_sub_ps(red_x, reach_x))),
+                _mm_and_ps(_mm_cmplt_ps(low_y, _mm_add_ps(new_red_y, reach_y)), _mm_cmpgt_ps(high_y, _mm_sub_ps(new_red_y, reach_y))));
+            __m128 near_blue = _mm_and_ps(_mm_and_ps(_mm_cmplt_ps(low_x, _mm_add_ps(blue_x, reach_x)), _mm_cmpgt_ps(high_x, _mm_sub_ps(blue_x, reach_x))),
+                _mm_and_ps(_mm_cmplt_ps(low_y, _mm_add_ps(new_blue_y, reach_y)), _mm_cmpgt_ps(high_y, _mm_sub_ps(new_blue_y, reach_y))));
+            __m128 crosses_wall = _mm_or_ps(_mm_cmpgt_ps(new_ball_y, limit), _mm_cmplt_ps(new_ball_y, negative_limit));
+            int flagged = _mm_movemask_ps(_mm_and_ps(running, _mm_or_ps(_mm_or_ps(near_red, near_blue), crosses_wall)));
+            if (flagged)
+            {
+                alignas(16) float spill[9][4];
+                _mm_store_ps(spill[0], ball_x);
+                _mm_store_ps(spill[1], ball_y);
+                _mm_store_ps(spill[2], ball_step);
+                _mm_store_ps(spill[3], new_red_y);
+                _mm_store_ps(spill[4], new_blue_y);
+                _mm_store_ps(spill[5], new_ball_x);
+                _mm_store_ps(spill[6], new_ball_y);
+                _mm_store_ps(spill[7], new_movement_x);
+                _mm_store_ps(spill[8], new_movement_y);
+                sweep_lanes(flagged, 4, spill[0], spill[1], spill[2], spill[3], spill[4], spill[5], spill[6], spill[7], spill[8]);
+                new_ball_x = _mm_load_ps(spill[5]);
+                new_ball_y = _mm_load_ps(spill[6]);
+                new_movement_x = _mm_load_ps(spill[7]);
+                new_movement_y = _mm_load_ps(spill[8]);
+            }
+
+            // Scored, else timed out, else still running
+            __m128i out_right = _mm_castps_si128(_mm_cmpgt_ps(ball_x, out_x)),
+                out_left = _mm_castps_si128(_mm_cmplt_ps(ball_x, negative_out_x)),
+                expired = _mm_castps_si128(_mm_cmpge_ps(new_elapsed_time, max_time));
+            __m128i new_outcome = _mm_and_si128(expired, timed_out);
+            new_outcome = _mm_or_si128(_mm_and_si128(out_left, light_side_won), _mm_andnot_si128(out_left, new_outcome));
+            new_outcome = _mm_or_si128(_mm_and_si128(out_right, dark_side_won), _mm_andnot_si128(out_right, new_outcome));
+
+            ball_x = select_sse2(running, new_ball_x, ball_x);
+            ball_y = select_sse2(running, new_ball_y, ball_y);
+            movement_x = select_sse2(running, new_movement_x, movement_x);
+            movement_y = select_sse2(running, new_movement_y, movement_y);
+            red_y = select_sse2(running, new_red_y, red_y);
+            blue_y = select_sse2(running, new_blue_y, blue_y);
+            ball_speed = select_sse2(running, new_ball_speed, ball_speed);
+            elapsed_time = select_sse2(running, new_elapsed_time, elapsed_time);
+            outcome = _mm_or_si128(_mm_and_si128(running_int, new_outcome), _mm_andnot_si128(running_int, outcome));
+            step_count = _mm_sub_epi32(step_count, running_int);
+        }
+
+        _mm_storeu_ps(lanes.ball_x + i, ball_x);
+        _mm_storeu_ps(lanes.ball_y + i, ball_y);
+        _mm_storeu_ps(lanes.movement_x + i, movement_x);
+        _mm_storeu_ps(lanes.movement_y + i, movement_y);
+        _mm_storeu_ps(lanes.red_y + i, red_y);
+        _mm_storeu_ps(lanes.blue_y + i, blue_y);
+        _mm_storeu_ps(lanes.ball_speed + i, ball_speed);
+        _mm_storeu_ps(lanes.elapsed_time + i, elapsed_time);
+        _mm_storeu_si128((__m128i*)(lanes.outcome + i), outcome);
+        _mm_storeu_si128((__m128i*)(lanes.steps + i), step_count);
+    }
+}
+
+/* AVX2 */
+
+TARGET_AVX2 static inline __m256 bot_direction_avx2(__m256 ball_x, __m256 ball_y, __m256 movement_x, __m256 paddle_x, __m256 paddle_y, __m256 reaction_distance)
+{
+    const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f), sign = _mm256_set1_ps(-0.0f);
+    const __m256 dead_zone = _mm256_set1_ps(BOT_DEAD_ZONE), negative_dead_zone = _mm256_set1_ps(-BOT_DEAD_ZONE);
+
+    __m256 offset_x = _mm256_sub_ps(ball_x, paddle_x);
+    __m256 reacting = _mm256_and_ps(_mm256_cmp_ps(_mm256_mul_ps(offset_x, movement_x), zero, _CMP_LT_OQ),
+        _mm256_cmp_ps(_mm256_andnot_ps(sign, offset_x), reaction_distance, _CMP_LE_OQ));
+
+    __m256 offset_y = _mm256_sub_ps(ball_y, paddle_y);
+    __m256 direction = _mm256_sub_ps(_mm256_and_ps(_mm256_cmp_ps(offset_y, dead_zone, _CMP_GT_OQ), one),
+        _mm256_and_ps(_mm256_cmp_ps(offset_y, negative_dead_zone, _CMP_LT_OQ), one));
+    return _mm256_and_ps(reacting, direction);
+}
+
+TARGET_AVX2 static void step_avx2(const Lanes& lanes, size_t lane_count, float delta_time, float max_seconds, int steps)
+{
+    const __m256 dt = _mm256_set1_ps(delta_time), paddle_step = _mm256_set1_ps(g_paddle_speed * delta_time),
+        growth = _mm256_set1_ps(g_ball_speed_growth), max_time = _mm256_set1_ps(max_seconds),
+        limit = _mm256_set1_ps(g_paddles_height_limit), negative_limit = _mm256_set1_ps(-g_paddles_height_limit),
+        out_x = _mm256_set1_ps(g_out_of_bounds_x), negative_out_x = _mm256_set1_ps(-g_out_of_bounds_x),
+        reach_x = _mm256_set1_ps(REACH_X), reach_y = _mm256_set1_ps(REACH_Y),
+        red_x = _mm256_set1_ps(RED_X), blue_x = _mm256_set1_ps(BLUE_X), sign = _mm256_set1_ps(-0.0f);
+    const __m256i running_outcome = _mm256_set1_epi32(MatchBatch::RUNNING),
+        dark_side_won = _mm256_set1_epi32(MatchBatch::DARK_SIDE_WON),
+        light_side_won = _mm256_set1_epi32(MatchBatch::LIGHT_SIDE_WON),
+        timed_out = _mm256_set1_epi32(MatchBatch::TIMED_OUT);
+
+    for (size_t i = 0; i < lane_count; i += 8)
+    {
+        __m256 ball_x = _mm256_loadu_ps(lanes.ball_x + i), ball_y = _mm256_loadu_ps(lanes.ball_y + i),
+            movement_x = _mm256_loadu_ps(lanes.movement_x + i), movement_y = _mm256_loadu_ps(lanes.movement_y + i),
+            red_y = _mm256_loadu_ps(lanes.red_y + i), blue_y = _mm256_loadu_ps(lanes.blue_y + i),
+            ball_speed = _mm256_loadu_ps(lanes.ball_speed + i), elapsed_time = _mm256_loadu_ps(lanes.elapsed_time + i);
+        const __m256 red_reaction = _mm256_loadu_ps(lanes.red_reaction + i), blue_reaction = _mm256_loadu_ps(lanes.blue_reaction + i);
+        __m256i outcome = _mm256_loadu_si256((const __m256i*)(lanes.outcome + i)),
+            step_count = _mm256_loadu_si256((const __m256i*)(lanes.steps + i));
+
+        for (int step = 0; step < steps; step++)
+        {
+            const __m256i running_int = _mm256_cmpeq_epi32(outcome, running_outcome);
+            const __m256 running = _mm256_castsi256_ps(running_int);
+            if (_mm256_movemask_ps(running) == 0) break;
+
+            const __m256 new_elapsed_time = _mm256_add_ps(elapsed_time, dt);
+
+            __m256 red_direction = bot_direction_avx2(ball_x, ball_y, movement_x, red_x, red_y, red_reaction);
+            __m256 blue_direction = bot_direction_avx2(ball_x, ball_y, movement_x, blue_x, blue_y, blue_reaction);
+
+            __m256 new_ball_speed = _mm256_add_ps(ball_speed, _mm256_mul_ps(_mm256_mul_ps(growth, new_elapsed_time), dt));
+
+            __m256 new_red_y = _mm256_min_ps(_mm256_max_ps(_mm256_add_ps(red_y, _mm256_mul_ps(red_direction, paddle_step)), negative_limit), limit);
+            __m256 new_blue_y = _mm256_min_ps(_mm256_max_ps(_mm256_add_ps(blue_y, _mm256_mul_ps(blue_direction, paddle_step)), negative_limit), limit);
+
+            __m256 hit_red = _mm256_and_ps(_mm256_cmp_ps(_mm256_andnot_ps(sign, _mm256_sub_ps(ball_x, red_x)), reach_x, _CMP_LT_OQ),
+                _mm256_cmp_ps(_mm256_andnot_ps(sign, _mm256_sub_ps(ball_y, new_red_y)), reach_y, _CMP_LT_OQ));
+            __m256 hit_blue = _mm256_and_ps(_mm256_cmp_ps(_mm256_andnot_ps(sign, _mm256_sub_ps(ball_x, blue_x)), reach_x, _CMP_LT_OQ),
+                _mm256_cmp_ps(_mm256_andnot_ps(sign, _mm256_sub_ps(ball_y, new_blue_y)), reach_y, _CMP_LT_OQ));
+
+            __m256 abs_movement_x = _mm256_andnot_ps(sign, movement_x);
+            __m256 new_movement_x = _mm256_blendv_ps(movement_x, abs_movement_x, hit_red);
+            new_movement_x = _mm256_blendv_ps(new_movement_x, _mm256_or_ps(sign, new_movement_x), hit_blue);
+
+            __m256 abs_movement_y = _mm256_andnot_ps(sign, movement_y);
+            __m256 new_movement_y = _mm256_blendv_ps(movement_y, _mm256_or_ps(sign, movement_y), _mm256_cmp_ps(ball_y, limit, _CMP_GT_OQ));
+            new_movement_y = _mm256_blendv_ps(new_movement_y, abs_movement_y, _mm256_cmp_ps(ball_y, negative_limit, _CMP_LT_OQ));
+
+            __m256 ball_step = _mm256_mul_ps(new_ball_speed, dt);
+            __m256 new_ball_x = _mm256_add_ps(ball_x, _mm256_mul_ps(new_movement_x, ball_step));
+            __m256 new_ball_y = _mm256_add_ps(ball_y, _mm256_mul_ps(new_movement_y, ball_step));
+
+            __m256 low_x = _mm256_min_ps(ball_x, new_ball_x), high_x = _mm256_max_ps(ball_x, new_ball_x),
+                low_y = _mm256_min_ps(ball_y, new_ball_y), high_y = _mm256_max_ps(ball_y, new_ball_y);
+            __m256 near_red = _mm256_and_ps(
+                _mm256_and_ps(_mm256_cmp_ps(low_x, _mm256_add_ps(red_x, reach_x), _CMP_LT_OQ), _mm256_cmp_ps(high_x, _mm256_sub_ps(red_x, reach_x), _CMP_GT_OQ)),
+                _mm256_and_ps(_mm256_cmp_ps(low_y, _mm256_add_ps(new_red_y, reach_y), _CMP_LT_OQ), _mm256_cmp_ps(high_y, _mm256_sub_ps(new_red_y, reach_y), _CMP_GT_OQ)));
+            __m256 near_blue = _mm256_and_ps(
+                _mm256_and_ps(_mm256_cmp_ps(low_x, _mm256_add_ps(blue_x, reach_x), _CMP_LT_OQ), _mm256_cmp_ps(high_x, _mm256_sub_ps(blue_x, reach_x), _CMP_GT_OQ)),
+                _mm256_and_ps(_mm256_cmp_ps(low_y, _mm256_add_ps(new_blue_y, reach_y), _CMP_LT_OQ), _mm256_cmp_ps(high_y, _mm256_sub_ps(new_blue_y, reach_y), _CMP_GT_OQ)));
+            __m256 crosses_wall = _mm256_or_ps(_mm256_cmp_ps(new_ball_y, limit, _CMP_GT_OQ), _mm256_cmp_ps(new_ball_y, negative_limit, _CMP_LT_OQ));
+            int flagged = _mm256_movemask_ps(_mm256_and_ps(running, _mm256_or_ps(_mm256_or_ps(near_red, near_blue), crosses_wall)));
+            if (flagged)
+            {
+                alignas(32) float spill[9][8];
+                _mm256_store_ps(spill[0], ball_x);
+                _mm256_store_ps(spill[1], ball_y);
+                _mm256_store_ps(spill[2], ball_step);
+                _mm256_store_ps(spill[3], new_red_y);
+                _mm256_store_ps(spill[4], new_blue_y);
+                _mm256_store_ps(spill[5], new_ball_x);
+                _mm256_store_ps(spill[6], new_ball_y);
+                _mm256_store_ps(spill[7], new_movement_x);
+                _mm256_store_ps(spill[8], new_movement_y);
+                sweep_lanes(flagged, 8, spill[0], spill[1], spill[2], spill[3], spill[4], spill[5], spill[6], spill[7], spill[8]);
+                new_ball_x = _mm256_load_ps(spill[5]);
+                new_ball_y = _mm256_load_ps(spill[6]);
+                new_movement_x = _mm256_load_ps(spill[7]);
+                new_movement_y = _mm256_load_ps(spill[8]);
+            }
+
+            // Scored, else timed out, else still running
+            __m256i out_right = _mm256_castps_si256(_mm256_cmp_ps(ball_x, out_x, _CMP_GT_OQ)),
+                out_left = _mm256_castps_si256(_mm256_cmp_ps(ball_x, negative_out_x, _CMP_LT_OQ)),
+                expired = _mm256_castps_si256(_mm256_cmp_ps(new_elapsed_time, max_time, _CMP_GE_OQ));
+            __m256i new_outcome = _mm256_and_si256(expired, timed_out);
+            new_outcome = _mm256_blendv_epi8(new_outcome, light_side_won, out_left);
+            new_outcome = _mm256_blendv_epi8(new_outcome, dark_side_won, out_right);
+
+            ball_x = _mm256_blendv_ps(ball_x, new_ball_x, running);
+            ball_y = _mm256_blendv_ps(ball_y, new_ball_y, running);
+            movement_x = _mm256_blendv_ps(movement_x, new_movement_x, running);
+            movement_y = _mm256_blendv_ps(movement_y, new_movement_y, running);
+            red_y = _mm256_blendv_ps(red_y, new_red_y, running);
+            blue_y = _mm256_blendv_ps(blue_y, new_blue_y, running);
+            ball_speed = _mm256_blendv_ps(ball_speed, new_ball_speed, running);
+            elapsed_time = _mm256_blendv_ps(elapsed_time, new_elapsed_time, running);
+            outcome = _mm256_blendv_epi8(outcome, new_outcome, running_int);
+            step_count = _mm256_sub_epi32(step_count, running_int);
+        }
+
+        _mm256_storeu_ps(lanes.ball_x + i, ball_x);
+        _mm256_storeu_ps(lanes.ball_y + i, ball_y);
+        _mm256_storeu_ps(lanes.movement_x + i, movement_x);
+        _mm256_storeu_ps(lanes.movement_y + i, movement_y);
+        _mm256_storeu_ps(lanes.red_y + i, red_y);
+        _mm256_storeu_ps(lanes.blue_y + i, blue_y);
+        _mm256_storeu_ps(lanes.ball_speed + i, ball_speed);
+        _mm256_storeu_ps(lanes.elapsed_time + i, elapsed_time);
+        _mm256_storeu_si256((__m256i*)(lanes.outcome + i), outcome);
+        _mm256_storeu_si256((__m256i*)(lanes.steps + i), step_count);
+    }
+}
+
+#endif
+
+/* BATCH */
+
+MatchBatch::Kernel MatchBatch::best_kernel()
+{
+#ifdef MATCH_BATCH_X86
+    #ifdef _MSC_VER
+        // AVX2 needs the CPU flag and the OS saving the upper register halves
+        int info[4];
+        __cpuid(info, 1);
+        bool os_saves_ymm = (info[2] & (1 << 27)) and (info[2] & (1 << 28)) and (_xgetbv(0) & 6) == 6;
+        __cpuidex(info, 7, 0);
+        if (os_saves_ymm and (info[1] & (1 << 5))) return KERNEL_AVX2;
+    #else
+        if (__builtin_cpu_supports("avx2")) return KERNEL_AVX2;
+    #endif
+    return KERNEL_SSE2;
+#else
+    return KERNEL_SCALAR;
+#endif
+}
+
+const char* MatchBatch::get_kernel_name(Kernel kernel)
+{
+    switch (kernel)
+    {
+        case KERNEL_AVX2: return "avx2";
+        case KERNEL_SSE2: return "sse2";
+        default:          return "scalar";
+    }
+}
+
+void MatchBatch::reset(const std::vector<float>& red_reaction_distances, const std::vector<float>& blue_reaction_distances)
+{
+    size_t match_count = std::min(red_reaction_distances.size(), blue_reaction_distances.size());
+    size_t lane_count = (match_count + LANE_GROUP - 1) / LANE_GROUP * LANE_GROUP;
+
+    // Every match kicks off like start_game(): centred, heading up and left
+    m_red_y.assign(lane_count, INIT_POS_RED_PADDLE.y);
+    m_blue_y.assign(lane_count, INIT_POS_BLUE_PADDLE.y);
+    m_ball_x.assign(lane_count, 0.0f);
+    m_ball_y.assign(lane_count, 0.0f);
+    m_movement_x.assign(lane_count, -1.0f);
+    m_movement_y.assign(lane_count, 1.0f);
+    m_ball_speed.assign(lane_count, 1.0f);
+    m_elapsed_time.assign(lane_count, 0.0f);
+    m_red_reaction.assign(lane_count, 0.0f);
+    m_blue_reaction.assign(lane_count, 0.0f);
+    m_outcome_lanes.assign(lane_count, TIMED_OUT); // padding lanes never run
+    m_step_lanes.assign(lane_count, 0);
+    m_lane_match.assign(lane_count, -1);
+
+    for (size_t i = 0; i < match_count; i++)
+    {
+        m_red_reaction[i] = red_reaction_distances[i];
+        m_blue_reaction[i] = blue_reaction_distances[i];
+        m_outcome_lanes[i] = RUNNING;
+        m_lane_match[i] = (int32_t)i;
+    }
+    m_active_lanes = lane_count;
+
+    m_outcomes.assign(match_count, RUNNING);
+    m_match_seconds.assign(match_count, 0.0f);
+    m_match_steps.assign(match_count, 0);
+}
+
+void MatchBatch::compact()
+{
+    size_t kept = 0;
+    for (size_t lane = 0; lane < m_active_lanes; lane++)
+    {
+        int32_t match = m_lane_match[lane];
+        if (match < 0) continue;
+
+        if (m_outcome_lanes[lane] != RUNNING)
+        {
+            m_outcomes[match] = (Outcome)m_outcome_lanes[lane];
+            m_match_seconds[match] = m_elapsed_time[lane];
+            m_match_steps[match] = m_step_lanes[lane];
+            continue;
+        }
+
+        if (kept != lane)
+        {
+            m_red_y[kept] = m_red_y[lane];
+            m_blue_y[kept] = m_blue_y[lane];
+            m_ball_x[kept] = m_ball_x[lane];
+            m_ball_y[kept] = m_ball_y[lane];
+            m_movement_x[kept] = m_movement_x[lane];
+            m_movement_y[kept] = m_movement_y[lane];
+            m_ball_speed[kept] = m_ball_speed[lane];
+            m_elapsed_time[kept] = m_elapsed_time[lane];
+            m_red_reaction[kept] = m_red_reaction[lane];
+            m_blue_reaction[kept] = m_blue_reaction[lane];
+            m_outcome_lanes[kept] = m_outcome_lanes[lane];
+            m_step_lanes[kept] = m_step_lanes[lane];
+            m_lane_match[kept] = match;
+        }
+        kept++;
+    }
+
+    size_t active_lanes = (kept + LANE_GROUP - 1) / LANE_GROUP * LANE_GROUP;
+    for (size_t lane = kept; lane < active_lanes; lane++)
+    {
+        m_outcome_lanes[lane] = TIMED_OUT;
+        m_lane_match[lane] = -1;
+    }
+    m_active_lanes = active_lanes;
+}
+
+long long MatchBatch::run(float delta_time, float max_seconds, Kernel kernel, JobSystem* jobs)
+{
+    // Running an instruction set the CPU lacks would kill the process
+    const Kernel best = best_kernel();
+    if (kernel > best) kernel = best;
+
+    while (m_active_lanes > 0)
+    {
+        // Runs the pass on lanes [begin, end)
+        JobSystem::RangeBody pass = [&](size_t begin, size_t end)
+        {
+            Lanes lanes = {
+                m_red_y.data() + begin, m_blue_y.data() + begin, m_ball_x.data() + begin, m_ball_y.data() + begin,
+                m_movement_x.data() + begin, m_movement_y.data() + begin, m_ball_speed.data() + begin, m_elapsed_time.data() + begin,
+                m_red_reaction.data() + begin, m_blue_reaction.data() + begin,
+                m_outcome_lanes.data() + begin, m_step_lanes.data() + begin
+            };
+
+            switch (kernel)
+            {
+#ifdef MATCH_BATCH_X86
+                case KERNEL_AVX2: step_avx2(lanes, end - begin, delta_time, max_seconds, STEPS_PER_PASS); break;
+                case KERNEL_SSE2: step_sse2(lanes, end - begin, delta_time, max_seconds, STEPS_PER_PASS); break;
+#endif
+                default:          step_scalar(lanes, end - begin, delta_time, max_seconds, STEPS_PER_PASS); break;
+            }
+        };
+
+        if (jobs != nullptr) jobs->parallel_for(m_active_lanes, LANES_PER_JOB, pass);
+        else pass(0, m_active_lanes);
+
+        compact();
+    }
+
+    long long total_steps = 0;
+    for (int32_t steps : m_match_steps) total_steps += steps;
+    return total_steps;
+}
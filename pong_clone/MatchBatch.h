@@ -0,0 +1,75 @@
+/**
+ * @file MatchBatch.h
+ * @brief MatchBatch class declaration. Plays thousands of independent
+ * one-ball, two-bot matches in lockstep for AI evaluation and tuning sweeps.
+ * Every match is a lane in a set of structure-of-arrays buffers, and the
+ * simulate() rules (paddle clamp, paddle overlap, swept wall and paddle
+ * bounces, scoring) are applied to 4 or 8 lanes at a time with SSE2 or AVX2.
+ *
+ * A match plays out exactly as the headless runner would play it with the
+ * same reaction distances: the kernels perform the same float operations in
+ * the same order as simulate().
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class JobSystem;
+
+class MatchBatch
+{
+public:
+    enum Outcome : int32_t { RUNNING = 0, DARK_SIDE_WON, LIGHT_SIDE_WON, TIMED_OUT };
+    enum Kernel { KERNEL_SCALAR, KERNEL_SSE2, KERNEL_AVX2 };
+
+    // Lanes are allocated in multiples of the widest kernel
+    static constexpr size_t LANE_GROUP = 8;
+
+    // Steps run on a block of lanes before finished matches are compacted out
+    static constexpr int STEPS_PER_PASS = 256;
+
+    // Lanes handed to one job at a time when a pass runs across threads; a
+    // multiple of LANE_GROUP so no job splits a register block
+    static constexpr size_t LANES_PER_JOB = 1024;
+
+private:
+    // Per lane; lanes are reordered as matches finish
+    std::vector<float> m_red_y, m_blue_y,
+        m_ball_x, m_ball_y,
+        m_movement_x, m_movement_y,
+        m_ball_speed, m_elapsed_time,
+        m_red_reaction, m_blue_reaction;
+    std::vector<int32_t> m_outcome_lanes, m_step_lanes;
+    std::vector<int32_t> m_lane_match; // -1 for padding
+
+    size_t m_active_lanes = 0;
+
+    // Per match, filled in as each one finishes
+    std::vector<Outcome> m_outcomes;
+    std::vector<float> m_match_seconds;
+    std::vector<int32_t> m_match_steps;
+
+    void compact();
+
+public:
+    // One match per pair of reaction distances, all at kick-off
+    void reset(const std::vector<float>& red_reaction_distances, const std::vector<float>& blue_reaction_distances);
+
+    // Steps every match until it is decided or has run for max_seconds;
+    // returns the total number of steps taken across all matches. Lanes never
+    // touch one another, so spreading a pass over jobs changes nothing but
+    // the wall time. A kernel the CPU can't run drops to best_kernel().
+    long long run(float delta_time, float max_seconds, Kernel kernel, JobSystem* jobs = nullptr);
+
+    // The widest kernel this CPU supports
+    static Kernel best_kernel();
+    static const char* get_kernel_name(Kernel kernel);
+
+    size_t get_match_count() const { return m_outcomes.size(); };
+    Outcome get_outcome(size_t match) const { return m_outcomes[match]; };
+    float get_match_seconds(size_t match) const { return m_match_seconds[match]; };
+    int32_t get_match_steps(size_t match) const { return m_match_steps[match]; };
+};
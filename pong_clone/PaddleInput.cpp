@@ -0,0 +1,73 @@
+/**
+ * @file PaddleInput.cpp
+ * @brief Changes usually arrive in time order, so insertion is nearly always
+ * an append.
+ */
+#include <algorithm>
+#include "PaddleInput.h"
+
+void PaddleTimeline::set_key(Key key, bool down, double time)
+{
+    Change change = { std::max(time, m_integrated_until), key, down };
+
+    auto later = std::upper_bound(m_changes.begin(), m_changes.end(), change.time,
+        [](double time, const Change& other) { return time < other.time; });
+    m_changes.insert(later, change);
+}
+
+bool PaddleTimeline::is_latest_down(Key key) const
+{
+    for (auto change = m_changes.rbegin(); change != m_changes.rend(); ++change)
+    {
+        if (change->key == key) return change->down;
+    }
+    return m_down[key];
+}
+
+void PaddleTimeline::sync(const bool down[KEY_COUNT], double time)
+{
+    for (int key = 0; key < KEY_COUNT; key++)
+    {
+        if (is_latest_down((Key)key) != down[key]) set_key((Key)key, down[key], time);
+    }
+}
+
+float PaddleTimeline::get_latest_direction(Key up, Key down) const
+{
+    return (float)((int)is_latest_down(up) - (int)is_latest_down(down));
+}
+
+void PaddleTimeline::integrate(double from, double to, float& red_direction, float& blue_direction)
+{
+    double held[KEY_COUNT] = {};
+    double cursor = from;
+
+    while (not m_changes.empty() and m_changes.front().time < to)
+    {
+        const Change& change = m_changes.front();
+        double until = std::max(change.time, cursor);
+        for (int key = 0; key < KEY_COUNT; key++)
+        {
+            if (m_down[key]) held[key] += until - cursor;
+        }
+        cursor = until;
+
+        m_down[change.key] = change.down;
+        m_changes.pop_front();
+    }
+    for (int key = 0; key < KEY_COUNT; key++)
+    {
+        if (m_down[key]) held[key] += to - cursor;
+    }
+    m_integrated_until = std::max(m_integrated_until, to);
+
+    const double length = to - from;
+    if (length <= 0.0)
+    {
+        red_direction = (float)((int)m_down[RED_UP] - (int)m_down[RED_DOWN]);
+        blue_direction = (float)((int)m_down[BLUE_UP] - (int)m_down[BLUE_DOWN]);
+        return;
+    }
+    red_direction = (float)((held[RED_UP] - held[RED_DOWN]) / length);
+    blue_direction = (float)((held[BLUE_UP] - held[BLUE_DOWN]) / length);
+}
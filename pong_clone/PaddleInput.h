@@ -0,0 +1,50 @@
+/**
+ * @file PaddleInput.h
+ * @brief PaddleTimeline class declaration. Keeps every paddle key press and
+ * release with the time it happened, so each fixed step can be given the
+ * fraction of its own interval that a key was held for, rather than
+ * whatever the keyboard looked like when the frame began. Times are seconds
+ * on whatever clock the caller uses for step intervals.
+ */
+
+#pragma once
+
+#include <deque>
+
+class PaddleTimeline
+{
+public:
+    enum Key { RED_UP, RED_DOWN, BLUE_UP, BLUE_DOWN, KEY_COUNT };
+
+private:
+    struct Change
+    {
+        double time;
+        Key key;
+        bool down;
+    };
+
+    // Not yet integrated, oldest first
+    std::deque<Change> m_changes;
+
+    // Keys held as of m_integrated_until
+    bool m_down[KEY_COUNT] = {};
+    double m_integrated_until = 0.0;
+
+public:
+    // Changes stamped before time already integrated are moved up to it;
+    // steps that have run can't be changed
+    void set_key(Key key, bool down, double time);
+
+    // Records a change for every key whose latest state differs from down,
+    // which catches releases lost while the window was unfocused
+    void sync(const bool down[KEY_COUNT], double time);
+
+    // Time-weighted (up - down) of each paddle over [from, to), in -1 to 1.
+    // Consumes the changes up to to, so steps must be integrated in order.
+    void integrate(double from, double to, float& red_direction, float& blue_direction);
+
+    // Direction with every change so far applied, for a late latch
+    float get_latest_direction(Key up, Key down) const;
+    bool is_latest_down(Key key) const;
+};
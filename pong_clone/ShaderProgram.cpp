@@ -15,6 +15,13 @@
 #define GL_SILENCE_DEPRECATION
 #include "ShaderProgram.h"
 
+// GL has a single current program per context, whichever ShaderProgram
+// bound it
+static GLuint g_bound_program_id = 0;
+
+// glGetUniformLocation gives -1 for uniforms the shader does not have
+constexpr GLuint MISSING_UNIFORM = (GLuint)-1;
+
 
 void ShaderProgram::load(const char *vertex_shader_file, const char *fragment_shader_file) {
     
@@ -40,17 +47,40 @@ void ShaderProgram::load(const char *vertex_shader_file, const char *fragment_sh
     m_model_matrix_uniform      = glGetUniformLocation(m_program_id, "modelMatrix");
     m_projection_matrix_uniform = glGetUniformLocation(m_program_id, "projectionMatrix");
     m_view_matrix_uniform       = glGetUniformLocation(m_program_id, "viewMatrix");
+    m_view_projection_matrix_uniform = glGetUniformLocation(m_program_id, "viewProjectionMatrix");
     m_colour_uniform            = glGetUniformLocation(m_program_id, "color");
     
     m_position_attribute  = glGetAttribLocation(m_program_id, "position");
     m_tex_coord_attribute = glGetAttribLocation(m_program_id, "texCoord");
     
+    // Only present in the 2D sprite shader
+    m_instance_transform_attribute = glGetAttribLocation(m_program_id, "instanceTransform");
+    m_instance_rotation_attribute  = glGetAttribLocation(m_program_id, "instanceRotation");
+    m_instance_uv_attribute        = glGetAttribLocation(m_program_id, "instanceUV");
+    
+    // A freshly linked program holds none of the values we cached
+    m_model_matrix_set = m_projection_matrix_set = m_view_matrix_set = m_view_projection_matrix_set = m_colour_set = false;
+    
     set_colour(1.0f, 1.0f, 1.0f, 1.0f);
     
 }
 
+void ShaderProgram::use()
+{
+    if (g_bound_program_id == m_program_id)
+    {
+        m_stats.program_binds_skipped++;
+        return;
+    }
+
+    glUseProgram(m_program_id);
+    g_bound_program_id = m_program_id;
+    m_stats.program_binds_issued++;
+}
+
 void ShaderProgram::cleanup()
 {
+    if (g_bound_program_id == m_program_id) g_bound_program_id = 0;
     glDeleteProgram(m_program_id);
     glDeleteShader(m_vertex_shader);
     glDeleteShader(m_fragment_shader);
@@ -104,24 +134,55 @@ GLuint ShaderProgram::load_shader_from_string(const std::string &shaderContents,
 
 void ShaderProgram::set_colour(float red, float green, float blue, float alpha)
 {
-    glUseProgram(m_program_id);
+    if (m_colour_uniform == MISSING_UNIFORM) return;
+
+    glm::vec4 colour(red, green, blue, alpha);
+    if (m_colour_set && m_colour == colour)
+    {
+        m_stats.uniform_uploads_skipped++;
+        return;
+    }
+
+    use();
     glUniform4f(m_colour_uniform, red, green, blue, alpha);
+    m_colour = colour;
+    m_colour_set = true;
+    m_stats.uniform_uploads_issued++;
+}
+
+void ShaderProgram::set_matrix_uniform(GLuint uniform, const glm::mat4 &matrix, glm::mat4 &cached, bool &cached_set)
+{
+    if (uniform == MISSING_UNIFORM) return;
+
+    if (cached_set && cached == matrix)
+    {
+        m_stats.uniform_uploads_skipped++;
+        return;
+    }
+
+    use();
+    glUniformMatrix4fv(uniform, 1, GL_FALSE, &matrix[0][0]);
+    cached = matrix;
+    cached_set = true;
+    m_stats.uniform_uploads_issued++;
 }
 
 void ShaderProgram::set_view_matrix(const glm::mat4 &matrix)
 {
-    glUseProgram(m_program_id);
-    glUniformMatrix4fv(m_view_matrix_uniform, 1, GL_FALSE, &matrix[0][0]);
+    set_matrix_uniform(m_view_matrix_uniform, matrix, m_view_matrix, m_view_matrix_set);
 }
 
 void ShaderProgram::set_model_matrix(const glm::mat4 &matrix)
 {
-    glUseProgram(m_program_id);
-    glUniformMatrix4fv(m_model_matrix_uniform, 1, GL_FALSE, &matrix[0][0]);
+    set_matrix_uniform(m_model_matrix_uniform, matrix, m_model_matrix, m_model_matrix_set);
 }
 
 void ShaderProgram::set_projection_matrix(const glm::mat4 &matrix)
 {
-    glUseProgram(m_program_id);
-    glUniformMatrix4fv(m_projection_matrix_uniform, 1, GL_FALSE, &matrix[0][0]);
+    set_matrix_uniform(m_projection_matrix_uniform, matrix, m_projection_matrix, m_projection_matrix_set);
+}
+
+void ShaderProgram::set_view_projection_matrix(const glm::mat4 &matrix)
+{
+    set_matrix_uniform(m_view_projection_matrix_uniform, matrix, m_view_projection_matrix, m_view_projection_matrix_set);
 }
@@ -19,9 +19,21 @@
 #include <fstream>
 #include <sstream>
 #include "glm/mat4x4.hpp"
+#include "glm/vec4.hpp"
 
 class ShaderProgram
 {
+public:
+    // Calls actually made to GL versus calls dropped because the program
+    // was already bound or the uniform already held that value
+    struct Stats
+    {
+        int program_binds_issued = 0;
+        int program_binds_skipped = 0;
+        int uniform_uploads_issued = 0;
+        int uniform_uploads_skipped = 0;
+    };
+
 private:
     void cleanup();
     
@@ -33,26 +45,54 @@ private:
     GLuint m_projection_matrix_uniform;
     GLuint m_model_matrix_uniform;
     GLuint m_view_matrix_uniform;
+    GLuint m_view_projection_matrix_uniform;
     GLuint m_colour_uniform;
 
     GLuint m_position_attribute;
     GLuint m_tex_coord_attribute;
+    GLuint m_instance_transform_attribute;
+    GLuint m_instance_rotation_attribute;
+    GLuint m_instance_uv_attribute;
 
     GLuint m_vertex_shader;
     GLuint m_fragment_shader;
+
+    // Last values uploaded to each uniform, valid once the flag is set
+    glm::mat4 m_model_matrix, m_projection_matrix, m_view_matrix, m_view_projection_matrix;
+    glm::vec4 m_colour;
+    bool m_model_matrix_set = false,
+         m_projection_matrix_set = false,
+         m_view_matrix_set = false,
+         m_view_projection_matrix_set = false,
+         m_colour_set = false;
+
+    Stats m_stats;
+
+    void set_matrix_uniform(GLuint uniform, const glm::mat4 &matrix, glm::mat4 &cached, bool &cached_set);
     
 public:
 
     void load(const char *vertex_shader_file, const char *fragment_shader_file);
 
+    // Binds the program unless it is already the current one. Everything
+    // must go through this rather than glUseProgram for the cache to hold.
+    void use();
+
     void set_model_matrix(const glm::mat4 &matrix);
     void set_projection_matrix(const glm::mat4 &matrix);
     void set_view_matrix(const glm::mat4 &matrix);
+    void set_view_projection_matrix(const glm::mat4 &matrix);
     void set_colour(float red, float green, float blue, float alpha);
     
     GLuint const get_program_id()               const { return m_program_id;          };
     GLuint const get_position_attribute()       const { return m_position_attribute;  };
     GLuint const get_tex_coordinate_attribute() const { return m_tex_coord_attribute; };
+    GLuint const get_instance_transform_attribute() const { return m_instance_transform_attribute; };
+    GLuint const get_instance_rotation_attribute()  const { return m_instance_rotation_attribute;  };
+    GLuint const get_instance_uv_attribute()        const { return m_instance_uv_attribute;        };
+    
+    const Stats &get_stats() const { return m_stats; };
+    void reset_stats()             { m_stats = Stats(); };
     
     void set_program_id(GLuint program_id)                         { m_program_id = program_id;                   };
 };
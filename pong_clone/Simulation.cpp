@@ -0,0 +1,547 @@
+/**
+ * @file Simulation.cpp
+ * @brief Paddle movement, ball bouncing and scoring. Time only ever enters
+ * through the delta_time handed to simulate(), so a caller can step it at
+ * whatever fixed rate it likes.
+ */
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include "JobSystem.h"
+#include "Simulation.h"
+
+// Starting direction of ball i. The first three match the original three
+// balls, the rest alternate sides and fan out vertically.
+static void start_movement(size_t i, float& movement_x, float& movement_y)
+{
+    static const float FIRST_MOVEMENTS[3][2] = { { -1.0f, 1.0f }, { 1.0f, 1.0f }, { -1.0f, -1.0f } };
+    if (i < 3)
+    {
+        movement_x = FIRST_MOVEMENTS[i][0];
+        movement_y = FIRST_MOVEMENTS[i][1];
+        return;
+    }
+
+    float fan = (float)(i * 0.6180339887) - (float)(size_t)(i * 0.6180339887); // golden ratio sequence in [0, 1)
+    movement_x = (i % 2) ? 1.0f : -1.0f;
+    movement_y = fan * 2.0f - 1.0f;
+}
+
+// Runs body over every ball index, split into BALLS_PER_JOB ranges when
+// there's a job system to hand them to
+static void for_each_ball_range(JobSystem* jobs, size_t count, const JobSystem::RangeBody& body)
+{
+    if (jobs != nullptr) jobs->parallel_for(count, BALLS_PER_JOB, body);
+    else body(0, count);
+}
+
+void BallPool::resize(size_t count)
+{
+    size_t old_size = size();
+    x.resize(count, 0.0f);
+    y.resize(count, 0.0f);
+    previous_x.resize(count, 0.0f);
+    previous_y.resize(count, 0.0f);
+    movement_x.resize(count);
+    movement_y.resize(count);
+    alive.resize(count, 0);
+    needs_sweep.resize(count, 0);
+    next_movement_x.resize(count);
+    next_movement_y.resize(count);
+
+    for (size_t i = old_size; i < count; i++)
+    {
+        start_movement(i, movement_x[i], movement_y[i]);
+    }
+}
+
+GameState::GameState()
+{
+    set_ball_count(*this, 1);
+}
+
+void set_ball_count(GameState& state, int count)
+{
+    if (count < 1) count = 1;
+    if ((size_t)count > state.balls.size()) state.balls.resize(count);
+
+    for (size_t i = 0; i < state.balls.size(); i++)
+    {
+        state.balls.alive[i] = i < (size_t)count;
+    }
+    state.ball_count = count;
+}
+
+static void reset_paddles(GameState& state)
+{
+    state.red_paddle_position = INIT_POS_RED_PADDLE;
+    state.red_paddle_movement = glm::vec3(0.0f, 0.0f, 0.0f);
+    state.blue_paddle_position = INIT_POS_BLUE_PADDLE;
+    state.blue_paddle_movement = glm::vec3(0.0f, 0.0f, 0.0f);
+    state.previous_red_paddle_position = state.red_paddle_position;
+    state.previous_blue_paddle_position = state.blue_paddle_position;
+}
+
+// Puts every ball back in the centre with nothing to interpolate from
+static void centre_balls(BallPool& balls)
+{
+    std::fill(balls.x.begin(), balls.x.end(), 0.0f);
+    std::fill(balls.y.begin(), balls.y.end(), 0.0f);
+    std::fill(balls.previous_x.begin(), balls.previous_x.end(), 0.0f);
+    std::fill(balls.previous_y.begin(), balls.previous_y.end(), 0.0f);
+}
+
+void reset_game(GameState& state) {
+    state.start_game = false;
+    reset_paddles(state);
+
+    BallPool& balls = state.balls;
+    centre_balls(balls);
+    std::fill(balls.movement_x.begin(), balls.movement_x.end(), 0.0f);
+    std::fill(balls.movement_y.begin(), balls.movement_y.end(), 0.0f);
+
+    state.ball_speed = 1.0f;
+}
+
+void start_game(GameState& state) {
+    state.start_game = true;
+    state.dark_side_won = false;
+    state.light_side_won = false;
+    reset_paddles(state);
+
+    BallPool& balls = state.balls;
+    centre_balls(balls);
+    for (size_t i = 0; i < balls.size(); i++)
+    {
+        start_movement(i, balls.movement_x[i], balls.movement_y[i]);
+    }
+}
+
+enum SweepSurface { NO_SURFACE, TOP_WALL, BOTTOM_WALL, PADDLE_FACE, PADDLE_EDGE };
+
+// Slab test of the ray (x, y) + t * velocity against a paddle grown by the
+// ball's half width. Keeps the hit if it comes before hit_time.
+static void sweep_paddle(float x, float y, float velocity_x, float velocity_y, float paddle_x, float paddle_y,
+    float reach_x, float reach_y, float& hit_time, SweepSurface& surface, float& hit_paddle_x, float& hit_paddle_y)
+{
+    const float infinity = std::numeric_limits<float>::infinity();
+
+    float enter_x = -infinity, exit_x = infinity;
+    if (velocity_x != 0.0f)
+    {
+        float near_time = (paddle_x - reach_x - x) / velocity_x,
+            far_time = (paddle_x + reach_x - x) / velocity_x;
+        enter_x = std::min(near_time, far_time);
+        exit_x = std::max(near_time, far_time);
+    }
+    else if (fabsf(x - paddle_x) >= reach_x) return;
+
+    float enter_y = -infinity, exit_y = infinity;
+    if (velocity_y != 0.0f)
+    {
+        float near_time = (paddle_y - reach_y - y) / velocity_y,
+            far_time = (paddle_y + reach_y - y) / velocity_y;
+        enter_y = std::min(near_time, far_time);
+        exit_y = std::max(near_time, far_time);
+    }
+    else if (fabsf(y - paddle_y) >= reach_y) return;
+
+    // A ball already inside, or moving away, has a negative entry time
+    float enter = std::max(enter_x, enter_y),
+        exit = std::min(exit_x, exit_y);
+    if (enter < 0.0f or enter >= exit or enter >= hit_time) return;
+
+    hit_time = enter;
+    surface = enter_x >= enter_y ? PADDLE_FACE : PADDLE_EDGE;
+    hit_paddle_x = paddle_x;
+    hit_paddle_y = paddle_y;
+}
+
+void sweep_ball(float& x, float& y, float& movement_x, float& movement_y, float step,
+    float red_x, float red_y, float blue_x, float blue_y)
+{
+    const float reach_x = (g_paddle_width + g_ball_width) / 2.0f,
+        reach_y = (g_paddle_height + g_ball_width) / 2.0f;
+
+    // Time runs from 0 to 1 over the step
+    float remaining = 1.0f;
+    for (int bounce = 0; bounce <= MAX_BOUNCES_PER_STEP; bounce++)
+    {
+        const float velocity_x = movement_x * step,
+            velocity_y = movement_y * step;
+
+        float hit_time = remaining,
+            hit_paddle_x = 0.0f,
+            hit_paddle_y = 0.0f;
+        SweepSurface surface = NO_SURFACE;
+
+        if (bounce < MAX_BOUNCES_PER_STEP)
+        {
+            if (velocity_y > 0.0f and y < g_paddles_height_limit and (g_paddles_height_limit - y) / velocity_y < hit_time)
+            {
+                hit_time = (g_paddles_height_limit - y) / velocity_y;
+                surface = TOP_WALL;
+            }
+            else if (velocity_y < 0.0f and y > -g_paddles_height_limit and (-g_paddles_height_limit - y) / velocity_y < hit_time)
+            {
+                hit_time = (-g_paddles_height_limit - y) / velocity_y;
+                surface = BOTTOM_WALL;
+            }
+
+            sweep_paddle(x, y, velocity_x, velocity_y, red_x, red_y, reach_x, reach_y, hit_time, surface, hit_paddle_x, hit_paddle_y);
+            sweep_paddle(x, y, velocity_x, velocity_y, blue_x, blue_y, reach_x, reach_y, hit_time, surface, hit_paddle_x, hit_paddle_y);
+        }
+
+        if (surface == NO_SURFACE)
+        {
+            x += velocity_x * remaining;
+            y += velocity_y * remaining;
+            return;
+        }
+
+        x += velocity_x * hit_time;
+        y += velocity_y * hit_time;
+        remaining -= hit_time;
+
+        switch (surface)
+        {
+            case TOP_WALL:    movement_y = -fabsf(movement_y); break;
+            case BOTTOM_WALL: movement_y = fabsf(movement_y); break;
+            case PADDLE_FACE: movement_x = x > hit_paddle_x ? fabsf(movement_x) : -fabsf(movement_x); break;
+            case PADDLE_EDGE: movement_y = y > hit_paddle_y ? fabsf(movement_y) : -fabsf(movement_y); break;
+            default: break;
+        }
+    }
+}
+
+struct BallFlags
+{
+    int out_right = 0;
+    int out_left = 0;
+    int any_sweep = 0;
+};
+
+// Paddle overlap, wall bounce, movement and out-of-bounds test for every ball
+// in one branch-free pass, so the compiler can vectorise it. That pass also
+// flags every ball whose path this step might touch a wall or paddle, so only
+// those need sweeping for the exact point of impact. The arrays come in as
+// parameters because GCC only honours __restrict there.
+static BallFlags move_balls(float* __restrict x, float* __restrict y,
+    float* __restrict previous_x, float* __restrict previous_y,
+    float* __restrict movement_x, float* __restrict movement_y,
+    const uint8_t* __restrict alive, uint8_t* __restrict needs_sweep, size_t count,
+    float red_x, float red_y, float blue_x, float blue_y, float step)
+{
+    const float reach_x = (g_paddle_width + g_ball_width) / 2.0f,
+        reach_y = (g_paddle_height + g_ball_width) / 2.0f;
+
+    int out_right = 0,
+        out_left = 0,
+        any_sweep = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const float ball_x = x[i],
+            ball_y = y[i];
+
+        // Bitwise & rather than "and" keeps the loop free of branches
+        const bool hit_red = (fabsf(ball_x - red_x) < reach_x) & (fabsf(ball_y - red_y) < reach_y);
+        const bool hit_blue = (fabsf(ball_x - blue_x) < reach_x) & (fabsf(ball_y - blue_y) < reach_y);
+
+        float direction_x = movement_x[i];
+        direction_x = hit_red ? fabsf(direction_x) : direction_x;
+        direction_x = hit_blue ? -fabsf(direction_x) : direction_x;
+
+        float direction_y = movement_y[i];
+        direction_y = ball_y > g_paddles_height_limit ? -fabsf(direction_y) : direction_y;
+        direction_y = ball_y < -g_paddles_height_limit ? fabsf(direction_y) : direction_y;
+
+        const float ball_step = (float)alive[i] * step;
+        const float new_x = ball_x + direction_x * ball_step,
+            new_y = ball_y + direction_y * ball_step;
+
+        // Does the box swept by this step reach a wall or either paddle?
+        const float low_x = std::min(ball_x, new_x), high_x = std::max(ball_x, new_x),
+            low_y = std::min(ball_y, new_y), high_y = std::max(ball_y, new_y);
+        const bool near_red = (low_x < red_x + reach_x) & (high_x > red_x - reach_x) & (low_y < red_y + reach_y) & (high_y > red_y - reach_y);
+        const bool near_blue = (low_x < blue_x + reach_x) & (high_x > blue_x - reach_x) & (low_y < blue_y + reach_y) & (high_y > blue_y - reach_y);
+        const bool crosses_wall = (new_y > g_paddles_height_limit) | (new_y < -g_paddles_height_limit);
+        const uint8_t sweep = alive[i] & (uint8_t)(near_red | near_blue | crosses_wall);
+
+        movement_x[i] = direction_x;
+        movement_y[i] = direction_y;
+        previous_x[i] = ball_x;
+        previous_y[i] = ball_y;
+        x[i] = new_x;
+        y[i] = new_y;
+        needs_sweep[i] = sweep;
+        any_sweep |= sweep;
+
+        out_right |= alive[i] & (ball_x > g_out_of_bounds_x);
+        out_left |= alive[i] & (ball_x < -g_out_of_bounds_x);
+    }
+
+    BallFlags flags;
+    flags.out_right = out_right;
+    flags.out_left = out_left;
+    flags.any_sweep = any_sweep;
+    return flags;
+}
+
+static void update_balls(GameState& state, float delta_time)
+{
+    BallPool& balls = state.balls;
+    const size_t count = balls.size();
+
+    const float red_x = state.red_paddle_position.x,
+        red_y = state.red_paddle_position.y,
+        blue_x = state.blue_paddle_position.x,
+        blue_y = state.blue_paddle_position.y;
+
+    const float step = state.start_game ? state.ball_speed * delta_time : 0.0f;
+
+    // Flags only ever get set, so it doesn't matter which range sets them first
+    std::atomic<int> out_right(0), out_left(0), any_sweep(0);
+    for_each_ball_range(state.jobs, count, [&](size_t begin, size_t end)
+    {
+        BallFlags flags = move_balls(balls.x.data() + begin, balls.y.data() + begin,
+            balls.previous_x.data() + begin, balls.previous_y.data() + begin,
+            balls.movement_x.data() + begin, balls.movement_y.data() + begin,
+            balls.alive.data() + begin, balls.needs_sweep.data() + begin, end - begin,
+            red_x, red_y, blue_x, blue_y, step);
+        if (flags.out_right) out_right = 1;
+        if (flags.out_left) out_left = 1;
+        if (flags.any_sweep) any_sweep = 1;
+    });
+
+    if (any_sweep and step > 0.0f)
+    {
+        for_each_ball_range(state.jobs, count, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                if (not balls.needs_sweep[i]) continue;
+                balls.x[i] = balls.previous_x[i];
+                balls.y[i] = balls.previous_y[i];
+                sweep_ball(balls.x[i], balls.y[i], balls.movement_x[i], balls.movement_y[i], step, red_x, red_y, blue_x, blue_y);
+            }
+        });
+    }
+
+    if (out_right) {
+        state.dark_side_won = true;
+        reset_game(state);
+    }
+    else if (out_left) {
+        state.light_side_won = true;
+        reset_game(state);
+    }
+}
+
+BallCollisionStats collide_balls(BallPool& balls, BallGrid& grid, JobSystem* jobs, int max_candidates)
+{
+    const size_t count = balls.size();
+    const float* x = balls.x.data();
+    const float* y = balls.y.data();
+    const float* movement_x = balls.movement_x.data();
+    const float* movement_y = balls.movement_y.data();
+    const float contact_distance_squared = g_ball_width * g_ball_width;
+
+    grid.build(x, y, balls.alive.data(), count, g_ball_width);
+
+    std::atomic<size_t> total_candidates(0), total_contacts(0), total_capped_balls(0);
+    for_each_ball_range(jobs, count, [&](size_t begin, size_t end)
+    {
+        size_t range_candidates = 0,
+            range_contacts = 0,
+            range_capped_balls = 0;
+
+        for (size_t i = begin; i < end; i++)
+        {
+            float new_movement_x = movement_x[i],
+                new_movement_y = movement_y[i];
+
+            if (balls.alive[i])
+            {
+                int candidates = 0;
+                grid.for_each_near(x[i], y[i], [&](uint32_t j)
+                {
+                    if (j == i) return true;
+
+                    const float offset_x = x[j] - x[i],
+                        offset_y = y[j] - y[i];
+                    const float distance_squared = offset_x * offset_x + offset_y * offset_y;
+
+                    // Exchange the part of the relative movement along the line
+                    // between the centres, but only while they are closing in
+                    const float closing = (movement_x[j] - movement_x[i]) * offset_x + (movement_y[j] - movement_y[i]) * offset_y;
+                    if (distance_squared < contact_distance_squared and distance_squared > 0.0f and closing < 0.0f)
+                    {
+                        new_movement_x += closing / distance_squared * offset_x;
+                        new_movement_y += closing / distance_squared * offset_y;
+                        range_contacts++;
+                    }
+
+                    range_candidates++;
+                    if (++candidates == max_candidates)
+                    {
+                        range_capped_balls++;
+                        return false;
+                    }
+                    return true;
+                });
+            }
+
+            balls.next_movement_x[i] = new_movement_x;
+            balls.next_movement_y[i] = new_movement_y;
+        }
+
+        total_candidates += range_candidates;
+        total_contacts += range_contacts;
+        total_capped_balls += range_capped_balls;
+    });
+
+    balls.movement_x.swap(balls.next_movement_x);
+    balls.movement_y.swap(balls.next_movement_y);
+
+    // Each touching pair was counted from both sides
+    BallCollisionStats stats;
+    stats.candidates = total_candidates;
+    stats.contacts = total_contacts / 2;
+    stats.capped_balls = total_capped_balls;
+    return stats;
+}
+
+void simulate(GameState& state, const SimInput& input, float delta_time)
+{
+    state.elapsed_time += delta_time;
+
+    state.previous_red_paddle_position = state.red_paddle_position;
+    state.previous_blue_paddle_position = state.blue_paddle_position;
+
+    /* Discrete commands */
+    if (input.toggle_single_player) {
+        state.single_player_mode = not state.single_player_mode;
+        // The bot always runs at full speed, whatever fraction of a step the
+        // player last held a key for
+        state.single_player_mode_upwards_ball_direction = state.blue_paddle_movement.y < 0.0f ? -1.0f : 1.0f;
+    }
+
+    if (input.toggle_ball_collisions) {
+        state.ball_collisions = not state.ball_collisions;
+    }
+
+    if (input.ball_count_request > 0) {
+        set_ball_count(state, input.ball_count_request);
+    }
+
+    if (input.start_requested and not state.start_game) {
+        start_game(state);
+    }
+
+    state.red_paddle_movement.y = input.red_paddle_direction;
+    state.blue_paddle_movement.y = input.blue_paddle_direction;
+
+    /* Game logic */
+    if (state.start_game) {
+        state.ball_speed += g_ball_speed_growth * state.elapsed_time * delta_time;
+    }
+
+    /* RED PADDLE STUFF */
+    state.red_paddle_position += state.red_paddle_movement * g_paddle_speed * delta_time;
+
+    /* making sure red paddle doesn't go off window */
+    if (state.red_paddle_position.y > g_paddles_height_limit) {
+        state.red_paddle_position.y = g_paddles_height_limit;
+    }
+    else if (state.red_paddle_position.y < -g_paddles_height_limit) {
+        state.red_paddle_position.y = -g_paddles_height_limit;
+    }
+
+    /* BLUE PADDLE STUFF */
+    if (state.single_player_mode) {
+        state.blue_paddle_position.y += g_paddle_speed * delta_time * state.single_player_mode_upwards_ball_direction;
+        if (state.blue_paddle_position.y == g_paddles_height_limit) {
+            state.single_player_mode_upwards_ball_direction = -1;
+        }
+        else if (state.blue_paddle_position.y == -g_paddles_height_limit) {
+            state.single_player_mode_upwards_ball_direction = 1;
+        }
+    }
+    else {
+        state.blue_paddle_position += state.blue_paddle_movement * g_paddle_speed * delta_time;
+    }
+
+    /* making sure blue paddle doesn't go off window */
+    if (state.blue_paddle_position.y > g_paddles_height_limit) {
+        state.blue_paddle_position.y = g_paddles_height_limit;
+    }
+    else if (state.blue_paddle_position.y < -g_paddles_height_limit) {
+        state.blue_paddle_position.y = -g_paddles_height_limit;
+    }
+
+    /* BALL STUFF */
+    update_balls(state, delta_time);
+
+    if (state.ball_collisions and state.start_game and state.ball_count > 1) {
+        const int max_candidates = state.ball_count >= HEAVY_STRESS_BALL_COUNT ? HEAVY_STRESS_COLLISION_CANDIDATES : 0;
+        collide_balls(state.balls, state.ball_grid, state.jobs, max_candidates);
+    }
+}
+
+int advance(GameState& state, SimInput& input, double& accumulator, double frame_time, float fixed_delta_time,
+    const StepInputHook& before_step)
+{
+    accumulator += frame_time;
+
+    int steps = 0;
+    while (accumulator >= fixed_delta_time)
+    {
+        if (before_step) before_step(steps, input);
+        simulate(state, input, fixed_delta_time);
+        accumulator -= fixed_delta_time;
+        steps++;
+
+        input.toggle_single_player = false;
+        input.toggle_ball_collisions = false;
+        input.ball_count_request = 0;
+        input.start_requested = false;
+    }
+    return steps;
+}
+
+static void hash_bytes(uint64_t& hash, const void* data, size_t size)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+}
+
+uint64_t state_checksum(const GameState& state)
+{
+    uint64_t hash = 14695981039346656037ull;
+
+    hash_bytes(hash, &state.red_paddle_position, sizeof(state.red_paddle_position));
+    hash_bytes(hash, &state.blue_paddle_position, sizeof(state.blue_paddle_position));
+    hash_bytes(hash, &state.ball_count, sizeof(state.ball_count));
+    hash_bytes(hash, &state.ball_speed, sizeof(state.ball_speed));
+    hash_bytes(hash, &state.elapsed_time, sizeof(state.elapsed_time));
+    hash_bytes(hash, &state.single_player_mode_upwards_ball_direction, sizeof(state.single_player_mode_upwards_ball_direction));
+
+    const bool flags[] = { state.single_player_mode, state.ball_collisions, state.start_game, state.dark_side_won, state.light_side_won };
+    hash_bytes(hash, flags, sizeof(flags));
+
+    size_t count = (size_t)state.ball_count;
+    const BallPool& balls = state.balls;
+    hash_bytes(hash, balls.x.data(), count * sizeof(float));
+    hash_bytes(hash, balls.y.data(), count * sizeof(float));
+    hash_bytes(hash, balls.movement_x.data(), count * sizeof(float));
+    hash_bytes(hash, balls.movement_y.data(), count * sizeof(float));
+    hash_bytes(hash, balls.alive.data(), count);
+
+    return hash;
+}
@@ -0,0 +1,156 @@
+/**
+ * @file Simulation.h
+ * @brief Game rules for Star Wars Pong. Nothing in here touches SDL or
+ * OpenGL, so the same code drives both the windowed game and the headless
+ * runner.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "glm/vec3.hpp"
+#include "BallGrid.h"
+
+class JobSystem;
+
+constexpr float g_paddle_speed = 3.0f;
+
+constexpr float g_paddle_width = 0.1f;
+constexpr float g_ball_width = 0.2f;
+constexpr float g_paddle_height = 0.8f;
+
+// Ball speed gains this much per second, times the seconds played so far
+constexpr float g_ball_speed_growth = 0.000001f * 60.0f;
+
+constexpr float g_paddles_height_limit = 2.5f;
+constexpr float g_out_of_bounds_x = 4.0f + 1.0f;
+
+constexpr glm::vec3 INIT_POS_RED_PADDLE = glm::vec3(-4.0f, 0.0f, 0.0f),
+INIT_POS_BLUE_PADDLE = glm::vec3(4.0f, 0.0f, 0.0f);
+
+// Bounces resolved inside a single step before the ball just carries on
+constexpr int MAX_BOUNCES_PER_STEP = 4;
+
+// Balls handed to one job at a time when the ball passes run across threads
+constexpr size_t BALLS_PER_JOB = 4096;
+
+// Exact collisions test every pair of balls near one another, which goes
+// quadratic when a crowd shares one spot, as every ball does at kick-off.
+// The heavy stress mode alone stops each ball after this many candidates.
+// That drops real contacts, and which ones survive depends on the grid's
+// visit order rather than on distance.
+constexpr int HEAVY_STRESS_COLLISION_CANDIDATES = 32;
+
+// Ball counts behind the number keys; 4 and 5 are stress modes
+constexpr int STRESS_BALL_COUNT = 1000,
+HEAVY_STRESS_BALL_COUNT = 100000;
+
+// Everything the player can do in one step, already translated from keys
+struct SimInput
+{
+    // -1 to 1; in between when a key changed partway through the step
+    float red_paddle_direction = 0.0f;
+    float blue_paddle_direction = 0.0f;
+
+    bool toggle_single_player = false;  // T
+    bool toggle_ball_collisions = false; // C
+    int  ball_count_request = 0;        // number of live balls; 0 leaves it alone
+    bool start_requested = false;       // CAPSLOCK
+};
+
+// Every ball in the game, stored one array per component so the per-step
+// update runs as a single loop over contiguous memory. Movement is a
+// direction that gets scaled by GameState::ball_speed. previous_x/y hold the
+// positions from before the last step so rendering can interpolate.
+struct BallPool
+{
+    std::vector<float> x, y,
+        previous_x, previous_y,
+        movement_x, movement_y;
+    std::vector<uint8_t> alive;
+    std::vector<uint8_t> needs_sweep; // scratch for the step in progress
+    std::vector<float> next_movement_x, next_movement_y; // collision results before they replace movement
+
+    size_t size() const { return x.size(); }
+    void resize(size_t count);
+};
+
+struct GameState
+{
+    glm::vec3 red_paddle_position = INIT_POS_RED_PADDLE,
+        red_paddle_movement = glm::vec3(0.0f, 0.0f, 0.0f),
+        blue_paddle_position = INIT_POS_BLUE_PADDLE,
+        blue_paddle_movement = glm::vec3(0.0f, 0.0f, 0.0f);
+
+    glm::vec3 previous_red_paddle_position = INIT_POS_RED_PADDLE,
+        previous_blue_paddle_position = INIT_POS_BLUE_PADDLE;
+
+    BallPool balls;
+    int ball_count = 0; // live balls, always the first ball_count of the pool
+
+    float ball_speed = 1.0f;
+    float elapsed_time = 0.0f; // simulated seconds since the state was created
+
+    bool single_player_mode = false;
+    bool ball_collisions = true;
+    float single_player_mode_upwards_ball_direction = 1.0f;
+
+    bool start_game = false,
+        dark_side_won = false,
+        light_side_won = false;
+
+    BallGrid ball_grid; // rebuilt every step; kept to reuse its memory
+
+    // Spreads the ball passes across threads when set. Every ball only ever
+    // writes its own slots, so the outcome is the same with or without it.
+    JobSystem* jobs = nullptr;
+
+    GameState(); // one live ball
+};
+
+struct BallCollisionStats
+{
+    size_t candidates = 0; // pairs given a narrow-phase test
+    size_t contacts = 0;   // pairs found overlapping and approaching
+    size_t capped_balls = 0; // balls that stopped at max_candidates
+};
+
+void set_ball_count(GameState& state, int count);
+void reset_game(GameState& state);
+void start_game(GameState& state);
+
+// Advances the game by exactly delta_time seconds
+void simulate(GameState& state, const SimInput& input, float delta_time);
+
+// Bounces overlapping live balls that are moving towards each other off one
+// another as equal-mass circles. Every ball reads the others' movement from
+// before the pass and writes only its own, so the result doesn't depend on
+// the order balls are visited in. max_candidates, when not 0, stops each
+// ball after that many candidates and so misses contacts; see
+// HEAVY_STRESS_COLLISION_CANDIDATES.
+BallCollisionStats collide_balls(BallPool& balls, BallGrid& grid, JobSystem* jobs = nullptr, int max_candidates = 0);
+
+// Moves a ball step units along its movement, finding the time of impact with
+// the walls and both paddles (as they stand after this step's move) and
+// reflecting off up to MAX_BOUNCES_PER_STEP of them, so a fast ball or a long
+// step can't tunnel through a paddle
+void sweep_ball(float& x, float& y, float& movement_x, float& movement_y, float step,
+    float red_x, float red_y, float blue_x, float blue_y);
+
+// Called with each step's index within the frame before it runs, so the
+// caller can give every step its own paddle directions
+typedef std::function<void(int step, SimInput& input)> StepInputHook;
+
+// Adds frame_time to accumulator and runs as many fixed_delta_time steps as
+// it now holds. One-shot commands in input are cleared once a step has seen
+// them; paddle directions are left for the caller to resample, or set per
+// step by before_step. Returns the number of steps taken.
+int advance(GameState& state, SimInput& input, double& accumulator, double frame_time, float fixed_delta_time,
+    const StepInputHook& before_step = StepInputHook());
+
+// FNV-1a hash of everything that affects future steps; equal states always
+// hash equal, so replays can check they ended where the recording did
+uint64_t state_checksum(const GameState& state);
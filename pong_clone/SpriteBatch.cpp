@@ -0,0 +1,152 @@
+/**
+ * @file SpriteBatch.cpp
+ * @brief SpriteBatch writes the frame's per-sprite data (transform, UV rect
+ * and rotation) into the stream buffer, or its own instance buffer, in end(),
+ * then draws the unit quad once per texture run with
+ * glDrawElementsInstanced. The quad lives in a static vertex and index
+ * buffer recorded into a vertex array object at load time, along with every
+ * attribute's enable and divisor, so a frame only re-points the instance
+ * attributes.
+ */
+#define GL_SILENCE_DEPRECATION
+#include <cstddef>
+#include <cstring>
+#include "SpriteBatch.h"
+
+struct QuadVertex
+{
+    float x, y;
+    float u, v;
+};
+
+// Centred unit quad; v runs downwards to match the images' top-left origin
+static const QuadVertex QUAD_VERTICES[] = {
+    { -0.5f, -0.5f, 0.0f, 1.0f },
+    {  0.5f, -0.5f, 1.0f, 1.0f },
+    {  0.5f,  0.5f, 1.0f, 0.0f },
+    { -0.5f,  0.5f, 0.0f, 0.0f }
+};
+static const GLushort QUAD_INDICES[] = { 0, 1, 2, 0, 2, 3 };
+constexpr GLsizei QUAD_INDEX_COUNT = sizeof(QUAD_INDICES) / sizeof(QUAD_INDICES[0]);
+
+void SpriteBatch::load(const ShaderProgram &program, StreamBuffer *stream)
+{
+    m_stream = stream;
+
+    m_instance_transform_attribute = program.get_instance_transform_attribute();
+    m_instance_rotation_attribute  = program.get_instance_rotation_attribute();
+    m_instance_uv_attribute        = program.get_instance_uv_attribute();
+
+    glGenBuffers(1, &m_instance_buffer);
+
+    glGenVertexArrays(1, &m_vertex_array);
+    glBindVertexArray(m_vertex_array);
+
+    glGenBuffers(1, &m_quad_vertex_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, m_quad_vertex_buffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(QUAD_VERTICES), QUAD_VERTICES, GL_STATIC_DRAW);
+
+    const GLuint position_attribute = program.get_position_attribute(),
+        tex_coordinate_attribute = program.get_tex_coordinate_attribute();
+    glVertexAttribPointer(position_attribute, 2, GL_FLOAT, GL_FALSE, sizeof(QuadVertex),
+        (const void *)offsetof(QuadVertex, x));
+    glEnableVertexAttribArray(position_attribute);
+    glVertexAttribPointer(tex_coordinate_attribute, 2, GL_FLOAT, GL_FALSE, sizeof(QuadVertex),
+        (const void *)offsetof(QuadVertex, u));
+    glEnableVertexAttribArray(tex_coordinate_attribute);
+
+    // The element buffer binding is part of the vertex array's state
+    glGenBuffers(1, &m_quad_index_buffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_quad_index_buffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(QUAD_INDICES), QUAD_INDICES, GL_STATIC_DRAW);
+
+    const GLuint instance_attributes[] = { m_instance_transform_attribute, m_instance_rotation_attribute, m_instance_uv_attribute };
+    for (GLuint attribute : instance_attributes)
+    {
+        glEnableVertexAttribArray(attribute);
+        glVertexAttribDivisor(attribute, 1);
+    }
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void SpriteBatch::begin()
+{
+    m_instances.clear();
+    m_runs.clear();
+    m_stats = Stats();
+
+    // Other code may have bound textures since the last frame
+    m_bound_texture_id = 0;
+}
+
+void SpriteBatch::draw(const glm::vec4 &transform, GLuint texture_id, const glm::vec4 &uv_rect, float rotation)
+{
+    if (m_runs.empty() || m_runs.back().texture_id != texture_id)
+    {
+        m_runs.push_back({ texture_id, m_instances.size(), 0 });
+    }
+
+    m_instances.push_back({ transform, uv_rect, rotation });
+    m_runs.back().count++;
+}
+
+void SpriteBatch::set_instance_pointers(size_t first_instance)
+{
+    const GLsizei stride = sizeof(Instance);
+    const size_t base = (size_t)m_instance_base + first_instance * sizeof(Instance);
+
+    glVertexAttribPointer(m_instance_transform_attribute, 4, GL_FLOAT, GL_FALSE, stride,
+        (const void *)(base + offsetof(Instance, transform)));
+    glVertexAttribPointer(m_instance_rotation_attribute, 1, GL_FLOAT, GL_FALSE, stride,
+        (const void *)(base + offsetof(Instance, rotation)));
+    glVertexAttribPointer(m_instance_uv_attribute, 4, GL_FLOAT, GL_FALSE, stride,
+        (const void *)(base + offsetof(Instance, uv_rect)));
+
+    m_stats.attribute_pointer_changes++;
+}
+
+void SpriteBatch::end()
+{
+    m_stats.sprites = (int)m_instances.size();
+    if (m_instances.empty()) return;
+
+    const size_t instance_bytes = m_instances.size() * sizeof(Instance);
+    void *stream_data = m_stream != nullptr ? m_stream->begin_write(instance_bytes, m_instance_base) : nullptr;
+    if (stream_data != nullptr)
+    {
+        memcpy(stream_data, m_instances.data(), instance_bytes);
+        m_stream->end_write();
+        glBindBuffer(GL_ARRAY_BUFFER, m_stream->get_buffer_id());
+    }
+    else
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, m_instance_buffer);
+        // Orphan last frame's storage so the driver never waits on it
+        glBufferData(GL_ARRAY_BUFFER, instance_bytes, m_instances.data(), GL_STREAM_DRAW);
+        m_instance_base = 0;
+    }
+    m_stats.buffer_uploads++;
+
+    glBindVertexArray(m_vertex_array);
+
+    for (const Run &run : m_runs)
+    {
+        if (run.texture_id != m_bound_texture_id)
+        {
+            glBindTexture(GL_TEXTURE_2D, run.texture_id);
+            m_bound_texture_id = run.texture_id;
+            m_stats.texture_binds++;
+        }
+
+        // Without base-instance draws (GL 4.2) each run re-points the
+        // instance attributes at its slice of the buffer
+        set_instance_pointers(run.first);
+        glDrawElementsInstanced(GL_TRIANGLES, QUAD_INDEX_COUNT, GL_UNSIGNED_SHORT, nullptr, (GLsizei)run.count);
+        m_stats.draw_calls++;
+    }
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
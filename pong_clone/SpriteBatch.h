@@ -0,0 +1,90 @@
+/**
+ * @file SpriteBatch.h
+ * @brief SpriteBatch class declaration. Collects every sprite drawn in a
+ * frame and issues one instanced draw per run of sprites sharing a texture.
+ * Sprites are 2D quads, so each instance is a packed (x, y, width, height),
+ * an optional rotation and a UV rect: 36 bytes rather than a 64-byte model
+ * matrix plus its UV rect.
+ */
+
+#pragma once
+
+#ifdef _WINDOWS
+    #include <GL/glew.h>
+#endif
+#define GL_GLEXT_PROTOTYPES 1
+#include <SDL_opengl.h>
+#include <vector>
+#include "glm/vec4.hpp"
+#include "ShaderProgram.h"
+#include "StreamBuffer.h"
+#include "TextureAtlas.h"
+
+// (u, v, width, height) covering a whole texture
+constexpr glm::vec4 FULL_UV_RECT = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+
+class SpriteBatch
+{
+public:
+    // Reset by begin(), so after end() they describe the frame just drawn
+    struct Stats
+    {
+        int sprites = 0;
+        int draw_calls = 0;
+        int texture_binds = 0;
+        int buffer_uploads = 0;
+        int attribute_pointer_changes = 0;
+    };
+
+private:
+    struct Instance
+    {
+        glm::vec4 transform;
+        glm::vec4 uv_rect;
+        float rotation;
+    };
+
+    // Consecutive sprites with the same texture; order is kept so alpha
+    // blending still layers sprites the way they were submitted
+    struct Run
+    {
+        GLuint texture_id;
+        size_t first;
+        size_t count;
+    };
+
+    std::vector<Instance> m_instances;
+    std::vector<Run> m_runs;
+
+    GLuint m_vertex_array = 0;
+    GLuint m_quad_vertex_buffer = 0;
+    GLuint m_quad_index_buffer = 0;
+
+    GLuint m_instance_buffer = 0;       // used when there's no stream buffer or it's full
+    StreamBuffer *m_stream = nullptr;
+    GLintptr m_instance_base = 0;        // byte offset of this frame's instances
+    GLuint m_instance_transform_attribute = 0;
+    GLuint m_instance_rotation_attribute = 0;
+    GLuint m_instance_uv_attribute = 0;
+    GLuint m_bound_texture_id = 0;
+
+    Stats m_stats;
+
+    void set_instance_pointers(size_t first_instance);
+
+public:
+    // The program must be built from vertex_sprite2d.glsl. Builds the quad's
+    // buffers and vertex array, so it needs the GL context. With a stream
+    // buffer, instances are written into its current frame region.
+    void load(const ShaderProgram &program, StreamBuffer *stream = nullptr);
+
+    void begin();
+
+    // transform is (centre x, centre y, width, height) in world units;
+    // rotation is in radians about the centre
+    void draw(const glm::vec4 &transform, GLuint texture_id, const glm::vec4 &uv_rect = FULL_UV_RECT, float rotation = 0.0f);
+    void draw(const glm::vec4 &transform, const AtlasRegion &sprite, float rotation = 0.0f) { draw(transform, sprite.texture_id, sprite.uv_rect, rotation); };
+    void end();
+
+    const Stats &get_stats() const { return m_stats; };
+};
@@ -0,0 +1,114 @@
+/**
+ * @file StreamBuffer.cpp
+ * @brief The persistent mapping is coherent, so writes reach the GPU without
+ * explicit flushes. The fallback invalidates each range it maps, so the
+ * driver never copies old contents back before handing it out.
+ */
+#define GL_SILENCE_DEPRECATION
+#include <SDL.h>
+#include "StreamBuffer.h"
+
+// Upper bound on a single fence wait; a frame that takes this long has
+// bigger problems than a torn buffer
+constexpr GLuint64 FENCE_TIMEOUT_NS = 1000000000ull;
+
+void StreamBuffer::load(size_t region_size, bool allow_persistent)
+{
+    m_region_size = (region_size + WRITE_ALIGNMENT - 1) / WRITE_ALIGNMENT * WRITE_ALIGNMENT;
+    const GLsizeiptr buffer_size = (GLsizeiptr)(m_region_size * REGION_COUNT);
+
+    glGenBuffers(1, &m_buffer_id);
+    glBindBuffer(GL_ARRAY_BUFFER, m_buffer_id);
+
+    bool has_storage = false;
+    if (allow_persistent and SDL_GL_ExtensionSupported("GL_ARB_buffer_storage"))
+    {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, buffer_size, nullptr, flags);
+        m_persistent_data = (unsigned char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, buffer_size, flags);
+        has_storage = true;
+    }
+
+    if (m_persistent_data == nullptr)
+    {
+        // Buffer storage is immutable, so a failed mapping needs a new buffer
+        if (has_storage)
+        {
+            glDeleteBuffers(1, &m_buffer_id);
+            glGenBuffers(1, &m_buffer_id);
+            glBindBuffer(GL_ARRAY_BUFFER, m_buffer_id);
+        }
+        glBufferData(GL_ARRAY_BUFFER, buffer_size, nullptr, GL_STREAM_DRAW);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    m_region = 0;
+    m_region_used = 0;
+    m_stats = Stats();
+    m_stats.persistent = m_persistent_data != nullptr;
+}
+
+void StreamBuffer::begin_frame()
+{
+    bool persistent = m_stats.persistent;
+    m_stats = Stats();
+    m_stats.persistent = persistent;
+
+    m_region_used = 0;
+
+    GLsync& fence = m_fences[m_region];
+    if (fence == nullptr) return;
+
+    // Cheap check first, so a frame only counts as waiting if it had to
+    GLenum status = glClientWaitSync(fence, 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED)
+    {
+        m_stats.fence_waits++;
+        glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT_NS);
+    }
+
+    glDeleteSync(fence);
+    fence = nullptr;
+}
+
+void* StreamBuffer::begin_write(size_t size, GLintptr &offset)
+{
+    const size_t start = (m_region_used + WRITE_ALIGNMENT - 1) / WRITE_ALIGNMENT * WRITE_ALIGNMENT;
+    if (size == 0 or start + size > m_region_size)
+    {
+        m_stats.overflows++;
+        return nullptr;
+    }
+
+    offset = (GLintptr)(m_region * m_region_size + start);
+    m_region_used = start + size;
+    m_stats.writes++;
+    m_stats.bytes_written += size;
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_buffer_id);
+    if (m_persistent_data != nullptr) return m_persistent_data + offset;
+
+    void* data = glMapBufferRange(GL_ARRAY_BUFFER, offset, (GLsizeiptr)size,
+        GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+    m_write_mapped = data != nullptr;
+    return data;
+}
+
+void StreamBuffer::end_write()
+{
+    if (not m_write_mapped) return;
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_buffer_id);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    m_write_mapped = false;
+}
+
+void StreamBuffer::end_frame()
+{
+    GLsync& fence = m_fences[m_region];
+    if (fence != nullptr) glDeleteSync(fence);
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    m_region = (m_region + 1) % REGION_COUNT;
+}
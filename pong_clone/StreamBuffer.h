@@ -0,0 +1,76 @@
+/**
+ * @file StreamBuffer.h
+ * @brief StreamBuffer class declaration. One large GL buffer split into
+ * REGION_COUNT per-frame regions that the CPU writes per-frame data into
+ * while the GPU still reads the previous frames' regions. A fence after each
+ * frame's draws guards its region until the ring comes back round to it.
+ *
+ * Where GL_ARB_buffer_storage is available the whole buffer stays mapped for
+ * its lifetime; otherwise every write maps just its own range unsynchronized,
+ * which the fences make safe.
+ */
+
+#pragma once
+
+#ifdef _WINDOWS
+    #include <GL/glew.h>
+#endif
+#define GL_GLEXT_PROTOTYPES 1
+#include <SDL_opengl.h>
+#include <cstddef>
+
+class StreamBuffer
+{
+public:
+    // Frames the CPU can run ahead of the GPU before it has to wait
+    static constexpr int REGION_COUNT = 3;
+
+    // Every write starts on this boundary, which suits any vertex attribute
+    static constexpr size_t WRITE_ALIGNMENT = 64;
+
+    // Reset by begin_frame(), except the mapping mode
+    struct Stats
+    {
+        bool persistent = false;
+        int fence_waits = 0;     // frames that found the GPU still reading their region
+        int writes = 0;
+        int overflows = 0;       // writes refused because the region was full
+        size_t bytes_written = 0;
+    };
+
+private:
+    GLuint m_buffer_id = 0;
+    size_t m_region_size = 0;
+
+    unsigned char* m_persistent_data = nullptr; // whole buffer, when persistently mapped
+    bool m_write_mapped = false;                // a fallback write is mapped
+
+    int m_region = 0;
+    size_t m_region_used = 0;
+    GLsync m_fences[REGION_COUNT] = {};
+
+    Stats m_stats;
+
+public:
+    // Allocates REGION_COUNT regions of region_size bytes each. Pass false
+    // for allow_persistent to test the unsynchronized path anywhere.
+    void load(size_t region_size, bool allow_persistent = true);
+
+    // Waits until the GPU is done with this frame's region
+    void begin_frame();
+
+    // Returns size bytes of this frame's region to write into, and their
+    // offset within the buffer for glVertexAttribPointer, or nullptr when
+    // the region has no room left. The pointer is valid until end_write(),
+    // which must come before any draw reads the buffer. Leaves the buffer
+    // bound to GL_ARRAY_BUFFER.
+    void* begin_write(size_t size, GLintptr &offset);
+    void end_write();
+
+    // Fences the frame's draws and moves on to the next region
+    void end_frame();
+
+    GLuint get_buffer_id() const { return m_buffer_id; };
+    size_t get_region_size() const { return m_region_size; };
+    const Stats &get_stats() const { return m_stats; };
+};
@@ -0,0 +1,225 @@
+/**
+ * @file TextureAtlas.cpp
+ * @brief Atlas pages are sized to what was actually packed into them and
+ * filled image by image, either with glTexSubImage2D from decoded pixels or
+ * by the caller through reserve(), so there is never a page-sized staging
+ * copy on the CPU.
+ */
+#define GL_SILENCE_DEPRECATION
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include "TextureAtlas.h"
+
+// Gap left around every image so nearest sampling never reads a neighbour
+constexpr int ATLAS_PADDING = 2;
+
+constexpr GLint LEVEL_OF_DETAIL = 0,
+TEXTURE_BORDER = 0;
+
+void SkylinePacker::init(int width, int height)
+{
+    m_width = width;
+    m_height = height;
+    m_skyline.clear();
+    m_skyline.push_back({ 0, 0, width });
+}
+
+int SkylinePacker::fit(size_t index, int width, int height) const
+{
+    int x = m_skyline[index].x;
+    if (x + width > m_width) return -1;
+
+    int y = 0;
+    int width_left = width;
+    for (size_t i = index; width_left > 0; i++)
+    {
+        y = std::max(y, m_skyline[i].y);
+        if (y + height > m_height) return -1;
+        width_left -= m_skyline[i].width;
+    }
+    return y;
+}
+
+bool SkylinePacker::insert(int width, int height, int &out_x, int &out_y)
+{
+    int best_top = m_height + 1,
+        best_width = m_width + 1;
+    size_t best_index = m_skyline.size();
+
+    for (size_t i = 0; i < m_skyline.size(); i++)
+    {
+        int y = fit(i, width, height);
+        if (y < 0) continue;
+
+        // Lowest top edge wins, then the narrowest segment to waste less
+        if (y + height < best_top or (y + height == best_top and m_skyline[i].width < best_width))
+        {
+            best_top = y + height;
+            best_width = m_skyline[i].width;
+            best_index = i;
+            out_y = y;
+        }
+    }
+
+    if (best_index == m_skyline.size()) return false;
+
+    out_x = m_skyline[best_index].x;
+    m_skyline.insert(m_skyline.begin() + best_index, { out_x, out_y + height, width });
+
+    // Trim or drop the segments the new rectangle now covers
+    for (size_t i = best_index + 1; i < m_skyline.size();)
+    {
+        Segment &previous = m_skyline[i - 1];
+        Segment &segment = m_skyline[i];
+        int overlap = previous.x + previous.width - segment.x;
+        if (overlap <= 0) break;
+
+        if (overlap >= segment.width)
+        {
+            m_skyline.erase(m_skyline.begin() + i);
+            continue;
+        }
+        segment.x += overlap;
+        segment.width -= overlap;
+        break;
+    }
+
+    // Merge neighbours left at the same height
+    for (size_t i = 0; i + 1 < m_skyline.size();)
+    {
+        if (m_skyline[i].y == m_skyline[i + 1].y)
+        {
+            m_skyline[i].width += m_skyline[i + 1].width;
+            m_skyline.erase(m_skyline.begin() + i + 1);
+        }
+        else i++;
+    }
+
+    return true;
+}
+
+int SkylinePacker::get_used_width() const
+{
+    int width = 0;
+    for (const Segment &segment : m_skyline)
+    {
+        if (segment.y > 0) width = segment.x + segment.width;
+    }
+    return width;
+}
+
+int SkylinePacker::get_used_height() const
+{
+    int height = 0;
+    for (const Segment &segment : m_skyline) height = std::max(height, segment.y);
+    return height;
+}
+
+std::vector<AtlasPlacement> TextureAtlas::reserve(const std::vector<glm::ivec2> &sizes, int page_size)
+{
+    GLint max_texture_size;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_texture_size);
+    page_size = std::min(page_size, (int)max_texture_size);
+
+    // Tallest first packs a skyline much tighter than submission order
+    std::vector<size_t> order(sizes.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = i;
+    std::sort(order.begin(), order.end(), [&sizes](size_t a, size_t b)
+    {
+        if (sizes[a].y != sizes[b].y) return sizes[a].y > sizes[b].y;
+        return sizes[a].x > sizes[b].x;
+    });
+
+    std::vector<SkylinePacker> packers;
+    std::vector<AtlasPlacement> placements(sizes.size());
+
+    for (size_t index : order)
+    {
+        int width = sizes[index].x + 2 * ATLAS_PADDING,
+            height = sizes[index].y + 2 * ATLAS_PADDING;
+
+        if (width > page_size or height > page_size)
+        {
+            std::cout << "Image of " << sizes[index].x << "x" << sizes[index].y
+                      << " does not fit in a " << page_size << " atlas page." << std::endl;
+            assert(false);
+            continue;
+        }
+
+        AtlasPlacement &placement = placements[index];
+        bool placed = false;
+        for (size_t page = 0; page < packers.size() and not placed; page++)
+        {
+            placed = packers[page].insert(width, height, placement.x, placement.y);
+            placement.page = page;
+        }
+
+        if (not placed)
+        {
+            packers.emplace_back();
+            packers.back().init(page_size, page_size);
+            packers.back().insert(width, height, placement.x, placement.y);
+            placement.page = packers.size() - 1;
+        }
+    }
+
+    // Every page is only as big as what landed in it
+    size_t first_page = m_pages.size();
+    for (const SkylinePacker &packer : packers)
+    {
+        GLuint texture_id;
+        glGenTextures(1, &texture_id);
+        glBindTexture(GL_TEXTURE_2D, texture_id);
+
+        glm::ivec2 size(packer.get_used_width(), packer.get_used_height());
+        glTexImage2D(GL_TEXTURE_2D, LEVEL_OF_DETAIL, GL_RGBA, size.x, size.y, TEXTURE_BORDER, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        m_pages.push_back(texture_id);
+        m_page_sizes.push_back(size);
+    }
+
+    for (AtlasPlacement &placement : placements)
+    {
+        placement.page += first_page;
+        placement.x += ATLAS_PADDING;
+        placement.y += ATLAS_PADDING;
+    }
+    return placements;
+}
+
+std::vector<AtlasRegion> TextureAtlas::build(const std::vector<AtlasImage> &images, int page_size)
+{
+    std::vector<glm::ivec2> sizes;
+    for (const AtlasImage &image : images) sizes.push_back(glm::ivec2(image.width, image.height));
+    std::vector<AtlasPlacement> placements = reserve(sizes, page_size);
+
+    std::vector<AtlasRegion> regions(images.size());
+    for (size_t index = 0; index < images.size(); index++)
+    {
+        const AtlasImage &image = images[index];
+        const AtlasPlacement &placement = placements[index];
+
+        glBindTexture(GL_TEXTURE_2D, m_pages[placement.page]);
+        glTexSubImage2D(GL_TEXTURE_2D, LEVEL_OF_DETAIL, placement.x, placement.y, image.width, image.height, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels);
+
+        regions[index] = get_region(placement, image.width, image.height);
+    }
+
+    return regions;
+}
+
+AtlasRegion TextureAtlas::get_region(const AtlasPlacement &placement, int width, int height) const
+{
+    const glm::ivec2 &size = m_page_sizes[placement.page];
+
+    // Inset by half a texel so sampling stays inside the image
+    AtlasRegion region;
+    region.texture_id = m_pages[placement.page];
+    region.uv_rect = glm::vec4(
+        (placement.x + 0.5f) / size.x, (placement.y + 0.5f) / size.y,
+        (width - 1.0f) / size.x, (height - 1.0f) / size.y);
+    return region;
+}
@@ -0,0 +1,92 @@
+/**
+ * @file TextureAtlas.h
+ * @brief TextureAtlas class declaration. Packs decoded RGBA images into as
+ * few GL textures ("pages") as possible at load time and hands out the UV
+ * rect of each image, so sprites with different pictures can share one
+ * texture bind and one batched draw.
+ */
+
+#pragma once
+
+#ifdef _WINDOWS
+    #include <GL/glew.h>
+#endif
+#define GL_GLEXT_PROTOTYPES 1
+#include <SDL_opengl.h>
+#include <vector>
+#include "glm/vec2.hpp"
+#include "glm/vec4.hpp"
+
+// Where an image ended up: which page, and its (u, v, width, height) there
+struct AtlasRegion
+{
+    GLuint texture_id = 0;
+    glm::vec4 uv_rect = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+};
+
+// A decoded, tightly packed RGBA image; the atlas never takes ownership
+struct AtlasImage
+{
+    int width = 0;
+    int height = 0;
+    const unsigned char *pixels = nullptr;
+};
+
+// Where an image's top-left texel goes, inside its padding
+struct AtlasPlacement
+{
+    size_t page = 0;
+    int x = 0, y = 0;
+};
+
+// Skyline bottom-left rectangle packer. Keeps the top edge of everything
+// placed so far as a list of horizontal segments and puts each new rectangle
+// where its top ends up lowest.
+class SkylinePacker
+{
+private:
+    struct Segment
+    {
+        int x, y, width;
+    };
+
+    int m_width = 0;
+    int m_height = 0;
+    std::vector<Segment> m_skyline;
+
+    // y at which a width x height rectangle fits starting at segment index,
+    // or -1 if it does not fit there
+    int fit(size_t index, int width, int height) const;
+
+public:
+    void init(int width, int height);
+    bool insert(int width, int height, int &out_x, int &out_y);
+
+    // Smallest box holding everything placed so far
+    int get_used_width() const;
+    int get_used_height() const;
+};
+
+class TextureAtlas
+{
+private:
+    std::vector<GLuint> m_pages;
+    std::vector<glm::ivec2> m_page_sizes;
+
+public:
+    // Packs images of the given sizes into new pages and creates the page
+    // textures with undefined contents, so pixels can be decoded straight
+    // into wherever they will live. Returns one placement per size in the
+    // same order. Pages are capped at page_size or GL_MAX_TEXTURE_SIZE.
+    std::vector<AtlasPlacement> reserve(const std::vector<glm::ivec2> &sizes, int page_size);
+
+    // Packs and uploads every image, returning one region per image in the
+    // same order
+    std::vector<AtlasRegion> build(const std::vector<AtlasImage> &images, int page_size);
+
+    AtlasRegion get_region(const AtlasPlacement &placement, int width, int height) const;
+
+    size_t get_page_count() const { return m_pages.size(); };
+    GLuint get_page(size_t page) const { return m_pages[page]; };
+    const glm::ivec2 &get_page_size(size_t page) const { return m_page_sizes[page]; };
+};
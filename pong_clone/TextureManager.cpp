@@ -0,0 +1,210 @@
+/**
+ * @file TextureManager.cpp
+ * @brief Workers only ever map cooked files, read image headers or decode into buffers
+ * upload() has mapped; everything that touches GL happens in upload(), on the caller's thread.
+ */
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include "TextureManager.h"
+#include "stb_image.h"
+
+void TextureManager::start(unsigned worker_count)
+{
+    if (worker_count == 0) worker_count = std::max(1u, std::thread::hardware_concurrency());
+
+    m_stopping = false;
+    for (unsigned i = 0; i < worker_count; i++)
+    {
+        m_workers.emplace_back(&TextureManager::worker_loop, this);
+    }
+}
+
+void TextureManager::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_work_available.notify_all();
+
+    for (std::thread &worker : m_workers) worker.join();
+    m_workers.clear();
+}
+
+void TextureManager::worker_loop()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        m_work_available.wait(lock, [this] { return m_stopping or not m_queue.empty(); });
+        if (m_queue.empty()) return;
+
+        Entry &entry = m_entries[m_queue.front()];
+        m_queue.pop_front();
+
+        lock.unlock();
+        if (entry.destination == nullptr) read_size(entry);
+        else decode(entry);
+        lock.lock();
+
+        if (--m_pending == 0) m_work_done.notify_all();
+    }
+}
+
+void TextureManager::read_size(Entry &entry)
+{
+    entry.from_cache = open_cooked_asset(entry.filepath.c_str(), entry.cooked);
+    if (entry.from_cache)
+    {
+        entry.image = entry.cooked.image;
+        return;
+    }
+
+    int number_of_components;
+    if (not stbi_info(entry.filepath.c_str(), &entry.image.width, &entry.image.height, &number_of_components))
+    {
+        std::cout << "Unable to load image " << entry.filepath << ": " << stbi_failure_reason() << std::endl;
+        assert(false);
+    }
+}
+
+void TextureManager::decode(Entry &entry)
+{
+    const int row_bytes = entry.image.width * 4;
+
+    if (entry.from_cache)
+    {
+        for (int row = 0; row < entry.image.height; row++)
+        {
+            memcpy(entry.destination + (size_t)row * entry.destination_stride, entry.image.pixels + (size_t)row * row_bytes, row_bytes);
+        }
+        return;
+    }
+
+    int width, height, number_of_components;
+    if (not stbi_load_into(entry.filepath.c_str(), entry.destination, entry.destination_stride,
+        entry.image.width, entry.image.height, &width, &height, &number_of_components, STBI_rgb_alpha))
+    {
+        std::cout << "Unable to load image " << entry.filepath << ": " << stbi_failure_reason() << std::endl;
+        assert(false);
+    }
+}
+
+void TextureManager::queue(Handle handle)
+{
+    m_queue.push_back(handle);
+    m_pending++;
+    m_work_available.notify_one();
+}
+
+void TextureManager::wait_for_workers()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_work_done.wait(lock, [this] { return m_pending == 0; });
+}
+
+TextureManager::Handle TextureManager::request(const std::string &filepath)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto found = m_handles.find(filepath);
+    if (found != m_handles.end()) return found->second;
+
+    Handle handle = m_entries.size();
+    m_entries.push_back(Entry());
+    m_entries.back().filepath = filepath;
+    m_handles[filepath] = handle;
+
+    queue(handle);
+    return handle;
+}
+
+void TextureManager::upload(TextureAtlas &atlas, int page_size)
+{
+    wait_for_workers();
+
+    std::vector<Handle> handles;
+    std::vector<glm::ivec2> sizes;
+    for (Handle handle = 0; handle < m_entries.size(); handle++)
+    {
+        const Entry &entry = m_entries[handle];
+        if (entry.uploaded) continue;
+        handles.push_back(handle);
+        sizes.push_back(glm::ivec2(entry.image.width, entry.image.height));
+    }
+    if (handles.empty()) return;
+
+    const size_t first_page = atlas.get_page_count();
+    std::vector<AtlasPlacement> placements = atlas.reserve(sizes, page_size);
+    std::vector<Staging> staging(atlas.get_page_count() - first_page);
+
+    for (size_t i = 0; i < staging.size(); i++)
+    {
+        const glm::ivec2 &size = atlas.get_page_size(first_page + i);
+        const size_t page_bytes = (size_t)size.x * size.y * 4;
+
+        glGenBuffers(1, &staging[i].buffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging[i].buffer);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, page_bytes, nullptr, GL_STREAM_DRAW);
+        staging[i].data = (unsigned char *)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, page_bytes,
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+
+        // Without a mapping the page is staged on the heap instead
+        if (staging[i].data == nullptr)
+        {
+            glDeleteBuffers(1, &staging[i].buffer);
+            staging[i].buffer = 0;
+            staging[i].fallback.resize(page_bytes);
+            staging[i].data = staging[i].fallback.data();
+        }
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    // Workers write disjoint rectangles of the mapped pages
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (size_t i = 0; i < handles.size(); i++)
+        {
+            Entry &entry = m_entries[handles[i]];
+            const AtlasPlacement &placement = placements[i];
+            const int page_width = atlas.get_page_size(placement.page).x;
+
+            entry.destination_stride = page_width * 4;
+            entry.destination = staging[placement.page - first_page].data
+                + (size_t)placement.y * entry.destination_stride + (size_t)placement.x * 4;
+            queue(handles[i]);
+        }
+    }
+    wait_for_workers();
+
+    for (size_t i = 0; i < staging.size(); i++)
+    {
+        const glm::ivec2 &size = atlas.get_page_size(first_page + i);
+        glBindTexture(GL_TEXTURE_2D, atlas.get_page(first_page + i));
+
+        if (staging[i].buffer != 0)
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging[i].buffer);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size.x, size.y, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            glDeleteBuffers(1, &staging[i].buffer);
+        }
+        else
+        {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size.x, size.y, GL_RGBA, GL_UNSIGNED_BYTE, staging[i].data);
+        }
+    }
+
+    for (size_t i = 0; i < handles.size(); i++)
+    {
+        Entry &entry = m_entries[handles[i]];
+        entry.region = atlas.get_region(placements[i], entry.image.width, entry.image.height);
+        if (entry.from_cache) close_cooked_asset(entry.cooked);
+        entry.image.pixels = nullptr;
+        entry.destination = nullptr;
+        entry.uploaded = true;
+    }
+}
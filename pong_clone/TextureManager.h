@@ -0,0 +1,91 @@
+/**
+ * @file TextureManager.h
+ * @brief TextureManager class declaration. Decodes image files on a pool of
+ * worker threads, decoding each path only once however many times it is
+ * requested, and keeps the GL upload on the thread that owns the context.
+ * Up-to-date cooked files (see AssetCache.h) are used in place of decoding.
+ *
+ * Workers first read each image's size, the atlas is packed from those, and
+ * then the images are decoded straight into mapped pixel unpack buffers laid
+ * out like the atlas pages, so no image is ever held in memory of its own.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "AssetCache.h"
+#include "TextureAtlas.h"
+
+class TextureManager
+{
+public:
+    typedef size_t Handle;
+
+private:
+    struct Entry
+    {
+        std::string filepath;
+        AtlasImage image;      // pixels only set for cooked files
+        AtlasRegion region;
+        bool uploaded = false;
+
+        // Set when the pixels came from a cooked file rather than stbi_load
+        bool from_cache = false;
+        CookedAsset cooked;
+
+        // Where the worker decodes to; null while only the size is wanted
+        unsigned char *destination = nullptr;
+        int destination_stride = 0;
+    };
+
+    // One per new atlas page while upload() fills it
+    struct Staging
+    {
+        GLuint buffer = 0;                 // pixel unpack buffer, 0 if mapping failed
+        unsigned char *data = nullptr;
+        std::vector<unsigned char> fallback;
+    };
+
+    // A deque so workers can hold on to an entry while more are requested
+    std::deque<Entry> m_entries;
+    std::unordered_map<std::string, Handle> m_handles;
+
+    std::vector<std::thread> m_workers;
+    std::deque<Handle> m_queue;
+    size_t m_pending = 0;
+    bool m_stopping = false;
+
+    std::mutex m_mutex;
+    std::condition_variable m_work_available;
+    std::condition_variable m_work_done;
+
+    void worker_loop();
+    void read_size(Entry &entry);
+    void decode(Entry &entry);
+    void queue(Handle handle);
+    void wait_for_workers();
+
+public:
+    // worker_count of 0 picks one per hardware thread
+    void start(unsigned worker_count = 0);
+    void stop();
+    ~TextureManager() { stop(); }
+
+    // Queues the file for decoding; asking for the same path twice returns
+    // the same handle and decodes it once
+    Handle request(const std::string &filepath);
+
+    // Packs every requested image into the atlas, decodes them into the
+    // pages' unpack buffers on the workers and uploads the pages. Must be
+    // called on the thread that owns the GL context.
+    void upload(TextureAtlas &atlas, int page_size);
+
+    const AtlasRegion &get_region(Handle handle) const { return m_entries[handle].region; };
+    size_t get_unique_count() const { return m_entries.size(); };
+};
@@ -0,0 +1,26 @@
+/**
+ * @file Transform.h
+ * @brief Transform class declaration. A sprite's position and scale, handed
+ * to SpriteBatch as a packed (x, y, width, height).
+ */
+
+#pragma once
+
+#include "glm/vec3.hpp"
+#include "glm/vec4.hpp"
+
+class Transform
+{
+private:
+    glm::vec3 m_position;
+    glm::vec3 m_scale;
+
+public:
+    Transform(const glm::vec3& position = glm::vec3(0.0f), const glm::vec3& scale = glm::vec3(1.0f))
+        : m_position(position), m_scale(scale) {}
+
+    void set_position(const glm::vec3& position) { m_position = position; };
+
+    // (x, y, width, height) as SpriteBatch takes it
+    glm::vec4 get_sprite_transform() const { return glm::vec4(m_position.x, m_position.y, m_scale.x, m_scale.y); };
+};
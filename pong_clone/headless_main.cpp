@@ -0,0 +1,11 @@
+/**
+ * @file headless_main.cpp
+ * @brief Entry point of the pong_headless target, which links only the
+ * simulation and never pulls in SDL or OpenGL.
+ */
+#include "Headless.h"
+
+int main(int argc, char* argv[])
+{
+    return run_headless(argc, argv);
+}
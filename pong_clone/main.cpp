@@ -7,11 +7,31 @@
 #include <GL/glew.h>
 #endif
 
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <vector>
 #include <SDL.h>
 #include <SDL_opengl.h>
 #include "glm/mat4x4.hpp"
 #include "glm/gtc/matrix_transform.hpp"
 #include "ShaderProgram.h"
+#include "SpriteBatch.h"
+#include "StreamBuffer.h"
+#include "AssetCache.h"
+#include "CommandLine.h"
+#include "FramePacer.h"
+#include "FrameProfiler.h"
+#include "InputLog.h"
+#include "JobSystem.h"
+#include "PaddleInput.h"
+#include "TextureAtlas.h"
+#include "TextureManager.h"
+#include "Transform.h"
+#include "Simulation.h"
+#include "Headless.h"
 #include "stb_image.h"
 
 enum AppStatus { RUNNING, TERMINATED };
@@ -29,14 +49,22 @@ VIEWPORT_Y = 0,
 VIEWPORT_WIDTH = WINDOW_WIDTH,
 VIEWPORT_HEIGHT = WINDOW_HEIGHT;
 
-constexpr char V_SHADER_PATH[] = "shaders/vertex_textured.glsl",
+constexpr char V_SHADER_PATH[] = "shaders/vertex_sprite2d.glsl",
 F_SHADER_PATH[] = "shaders/fragment_textured.glsl";
 
-constexpr float MILLISECONDS_IN_SECOND = 1000.0;
+// The simulation always advances in steps of exactly this size; rendering
+// interpolates between the last two steps
+constexpr float FIXED_TIMESTEP = 1.0f / 120.0f;
 
-constexpr GLint NUMBER_OF_TEXTURES = 1, // to be generated, that is
-LEVEL_OF_DETAIL = 0, // mipmap reduction image level
-TEXTURE_BORDER = 0; // this value MUST be zero
+// After a hitch we drop time rather than run hundreds of catch-up steps
+constexpr double MAX_FRAME_TIME = 0.25;
+
+// Per-frame region of the stream buffer; holds the heavy stress mode's 100k
+// ball instances with room to spare
+constexpr size_t STREAM_REGION_SIZE = 4 * 1024 * 1024;
+
+// Every sprite is packed into atlas pages of at most this size
+constexpr int ATLAS_PAGE_SIZE = 4096;
 
 // source: https://red_paddlenoiro.jp/
 constexpr char RED_PADDLE_SPRITE_FILEPATH[] = "red_paddle.png",
@@ -47,102 +75,231 @@ START_GAME_PIC_FILEPATH[] = "start_game.png",
 DARK_SIDE_WINS_PIC_FILEPATH[] = "dark_side_wins.png",
 LIGHT_SIDE_WINS_PIC_FILEPATH[] = "light_side_wins.png";
 
+const char* const SPRITE_FILEPATHS[] = {
+    RED_PADDLE_SPRITE_FILEPATH, BLUE_PADDLE_SPRITE_FILEPATH, STARWARS_BG_SPRITE_FILEPATH, BALL_FILEPATH,
+    START_GAME_PIC_FILEPATH, LIGHT_SIDE_WINS_PIC_FILEPATH, DARK_SIDE_WINS_PIC_FILEPATH
+};
+constexpr size_t SPRITE_COUNT = sizeof(SPRITE_FILEPATHS) / sizeof(SPRITE_FILEPATHS[0]);
+
 constexpr glm::vec3 INIT_SCALE = glm::vec3(0.25f, 0.75595f, 0.0f),
 INIT_STARWARS_BG_SCALE = glm::vec3(15.0f, 8.43055f, 0.0f),
 INIT_BALL_SCALE = glm::vec3(0.3f, 0.3f, 0.0f),
-INIT_POS_RED_PADDLE = glm::vec3(-4.0f, 0.0f, 0.0f),
-INIT_POS_BLUE_PADDLE = glm::vec3(4.0f, 0.0f, 0.0f);
+PICTURE_SCALE = glm::vec3(10.0f, 5.0f, 0.0f);
 
 constexpr float ROT_INCREMENT = 1.0f;
 
 SDL_Window* g_display_window;
 AppStatus g_app_status = RUNNING;
 ShaderProgram g_shader_program = ShaderProgram();
+SpriteBatch g_sprite_batch;
+StreamBuffer g_stream_buffer;
+bool g_persistent_buffers = true; // --no-persistent-map forces the unsynchronized fallback
 
 glm::mat4 g_view_matrix,
-g_red_paddle_matrix,
-g_blue_paddle_matrix,
-g_starwars_bg_matrix,
-g_ball_matrix,
-g_ball2_matrix,
-g_ball3_matrix,
-g_projection_matrix,
-g_start_game_pic_matrix,
-g_dark_side_wins_pic_matrix,
-g_light_side_wins_pic_matrix;
-
-float g_previous_ticks = 0.0f;
-
-GLuint g_red_paddle_texture_id,
-g_blue_paddle_texture_id,
-g_starwars_bg_texture_id,
-g_ball_texture_id,
-g_ball2_texture_id,
-g_ball3_texture_id,
-g_start_game_pic_texture_id,
-g_dark_side_wins_pic_texture_id,
-g_light_side_wins_pic_texture_id;
-
-glm::vec3 g_red_paddle_position = glm::vec3(-4.0f, 0.0f, 0.0f),
-g_red_paddle_movement = glm::vec3(0.0f, 0.0f, 0.0f),
-g_blue_paddle_position = glm::vec3(4.0f, 0.0f, 0.0f),
-g_blue_paddle_movement = glm::vec3(0.0f, 0.0f, 0.0f),
-g_ball_position = glm::vec3(0.0f, 0.0f, 0.0f),
-g_ball_movement = glm::vec3(-1.0f, 1.0f, 0.0f),
-g_ball2_position = glm::vec3(0.0f, 0.0f, 0.0f),
-g_ball2_movement = glm::vec3(1.0f, 1.0f, 0.0f),
-g_ball3_position = glm::vec3(0.0f, 0.0f, 0.0f),
-g_ball3_movement = glm::vec3(-1.0f, -1.0f, 0.0f);
-
-
-
-constexpr float g_paddle_speed = 3.0f;
-float g_ball_speed = 1.0f;
-
-bool g_single_player_mode = false;
-
-float single_player_mode_upwards_ball_direction = 1.0;
-
-constexpr float g_paddle_width = 0.1f;
-constexpr float g_ball_width = 0.2f;
-constexpr float g_paddle_height = 0.8f;
-
-bool show_ball2 = false,
-show_ball3 = false;
-
-void reset_game();
-void start_game();
-
-bool g_start_game = false,
-g_dark_side_won = false,
-g_light_side_won = false;
-
-GLuint load_texture(const char* filepath)
+g_projection_matrix;
+
+// Where each sprite sits and how big it is; the sprite batch takes them as
+// packed (x, y, width, height) rather than model matrices
+Transform g_starwars_bg_transform = Transform(glm::vec3(0.0f), INIT_STARWARS_BG_SCALE),
+g_red_paddle_transform = Transform(INIT_POS_RED_PADDLE, INIT_SCALE),
+g_blue_paddle_transform = Transform(INIT_POS_BLUE_PADDLE, INIT_SCALE),
+g_start_game_pic_transform = Transform(glm::vec3(0.0f), PICTURE_SCALE),
+g_dark_side_wins_pic_transform = Transform(glm::vec3(0.0f), PICTURE_SCALE),
+g_light_side_wins_pic_transform = Transform(glm::vec3(0.0f), PICTURE_SCALE);
+
+std::vector<glm::vec4> g_ball_transforms;
+
+Uint64 g_previous_counter = 0;
+double g_accumulator = 0.0;
+
+// FIXED_TIMESTEP unless a replay was recorded with a different one
+float g_fixed_timestep = FIXED_TIMESTEP;
+
+TextureAtlas g_texture_atlas;
+
+AtlasRegion g_red_paddle_sprite,
+g_blue_paddle_sprite,
+g_starwars_bg_sprite,
+g_ball_sprite,
+g_start_game_pic_sprite,
+g_dark_side_wins_pic_sprite,
+g_light_side_wins_pic_sprite;
+
+GameState g_game_state;
+SimInput g_sim_input;
+
+// Shared by the ball passes and build_transforms(); --threads=N caps the
+// thread count, 1 keeps everything on the main thread
+JobSystem g_job_system;
+unsigned g_thread_count = JobSystem::default_worker_count() + 1;
+
+// --timings-interval=SECONDS logs the percentiles periodically; the CSV and
+// JSON files are written on exit
+FrameProfiler g_frame_profiler;
+
+// --pacing=vsync|adaptive|capped|uncapped picks how frames are paced;
+// --fps-cap=N sets the capped rate and implies --pacing=capped
+FramePacer g_frame_pacer;
+FramePacer::Mode g_pacing_mode = FramePacer::VSYNC;
+double g_fps_cap = FramePacer::DEFAULT_FPS_CAP;
+double g_timings_interval = 0.0;
+Uint64 g_last_timings_report = 0;
+const char* g_timings_csv_filepath = nullptr;
+const char* g_timings_json_filepath = nullptr;
+
+// --record=PATH logs every frame's input; --replay=PATH plays a log back in
+// real time, or as fast as possible with --replay-fast
+InputRecorder g_input_recorder;
+InputReplay g_input_replay;
+bool g_replay_fast = false;
+
+// Paddle keys take effect at the time SDL stamped them, partway through a
+// step if need be; --frame-input goes back to sampling them once per frame.
+// --late-latch re-reads them just before drawing.
+PaddleTimeline g_paddle_timeline;
+bool g_timestamped_input = true;
+bool g_late_latch = false;
+
+// Decodes every sprite on worker threads, then packs them into the atlas
+void load_sprites()
+{
+    AtlasRegion* sprites[SPRITE_COUNT] = {
+        &g_red_paddle_sprite, &g_blue_paddle_sprite, &g_starwars_bg_sprite, &g_ball_sprite,
+        &g_start_game_pic_sprite, &g_light_side_wins_pic_sprite, &g_dark_side_wins_pic_sprite
+    };
+
+    Uint64 start = SDL_GetPerformanceCounter();
+
+    TextureManager texture_manager;
+    texture_manager.start();
+
+    TextureManager::Handle handles[SPRITE_COUNT];
+    for (size_t i = 0; i < SPRITE_COUNT; i++)
+    {
+        handles[i] = texture_manager.request(SPRITE_FILEPATHS[i]);
+    }
+
+    texture_manager.upload(g_texture_atlas, ATLAS_PAGE_SIZE);
+
+    for (size_t i = 0; i < SPRITE_COUNT; i++)
+    {
+        *sprites[i] = texture_manager.get_region(handles[i]);
+    }
+
+    double milliseconds = (double)(SDL_GetPerformanceCounter() - start) * 1000.0 / (double)SDL_GetPerformanceFrequency();
+    LOG("Loaded " << texture_manager.get_unique_count() << " images into " << g_texture_atlas.get_page_count()
+        << " atlas pages in " << milliseconds << " ms");
+}
+
+// --cook [--cook-downscale=N] [--cook-raw] writes a .cooked file next to
+// every sprite so later runs can skip decoding; returns the exit code
+int cook_sprites(int argc, char* argv[])
+{
+    const char* downscale = find_option(argc, argv, "--cook-downscale");
+    int downscale_steps = downscale ? atoi(downscale) : 0;
+    bool compress = not has_flag(argc, argv, "--cook-raw");
+
+    bool all_cooked = true;
+    for (size_t i = 0; i < SPRITE_COUNT; i++)
+    {
+        all_cooked = cook_asset(SPRITE_FILEPATHS[i], downscale_steps, compress) and all_cooked;
+    }
+    return all_cooked ? 0 : 1;
+}
+
+// The zlib stream a PNG splits across its IDAT chunks; empty for other formats
+std::vector<char> png_zlib_stream(const std::vector<unsigned char>& png)
 {
-    // STEP 1: Loading the image file
-    int width, height, number_of_components;
-    unsigned char* image = stbi_load(filepath, &width, &height, &number_of_components, STBI_rgb_alpha);
+    const unsigned char SIGNATURE[] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+    std::vector<char> stream;
+    if (png.size() < sizeof(SIGNATURE) or memcmp(png.data(), SIGNATURE, sizeof(SIGNATURE)) != 0) return stream;
 
-    if (image == NULL)
+    // Each chunk is a big-endian length, a 4-byte type, the data and a CRC
+    for (size_t offset = sizeof(SIGNATURE); offset + 12 <= png.size();)
     {
-        LOG("Unable to load image. Make sure the path is correct.");
-        assert(false);
+        const unsigned char* chunk = png.data() + offset;
+        const size_t length = (size_t)chunk[0] << 24 | (size_t)chunk[1] << 16 | (size_t)chunk[2] << 8 | chunk[3];
+        if (offset + 12 + length > png.size()) break;
+        if (memcmp(chunk + 4, "IDAT", 4) == 0) stream.insert(stream.end(), chunk + 8, chunk + 8 + length);
+        offset += 12 + length;
     }
+    return stream;
+}
 
-    // STEP 2: Generating and binding a texture ID to our image
-    GLuint textureID;
-    glGenTextures(NUMBER_OF_TEXTURES, &textureID);
-    glBindTexture(GL_TEXTURE_2D, textureID);
-    glTexImage2D(GL_TEXTURE_2D, LEVEL_OF_DETAIL, GL_RGBA, width, height, TEXTURE_BORDER, GL_RGBA, GL_UNSIGNED_BYTE, image);
+// --bench-decode [--bench-runs=N] decodes every sprite from memory at each
+// SIMD level the CPU has, then times a PNG's inflate alone with and without
+// the fast inflate loop, and prints the best of N runs along with what the
+// load's inflate allocated; returns the exit code
+int bench_decode(int argc, char* argv[])
+{
+    const char* runs_option = find_option(argc, argv, "--bench-runs");
+    const int runs = runs_option ? std::max(1, atoi(runs_option)) : 10;
+    const char* const LEVEL_NAMES[] = { "scalar", "sse2", "ssse3", "avx2" };
+    const int best_level = stbi_get_simd_level();
+
+    for (size_t i = 0; i < SPRITE_COUNT; i++)
+    {
+        std::ifstream file(SPRITE_FILEPATHS[i], std::ios::binary);
+        std::vector<unsigned char> encoded((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (encoded.empty())
+        {
+            LOG("Unable to read " << SPRITE_FILEPATHS[i]);
+            return 1;
+        }
+
+        std::cout << SPRITE_FILEPATHS[i] << ':';
+        double scalar_ms = 0.0;
+        for (int level = STBI_SIMD_NONE; level <= best_level; level++)
+        {
+            stbi_set_simd_limit(level);
+
+            double best_ms = 0.0;
+            for (int run = 0; run < runs; run++)
+            {
+                int width, height, number_of_components;
+                Uint64 start = SDL_GetPerformanceCounter();
+                stbi_image_free(stbi_load_from_memory(encoded.data(), (int)encoded.size(), &width, &height,
+                    &number_of_components, STBI_rgb_alpha));
+                double ms = (double)(SDL_GetPerformanceCounter() - start) * 1000.0 / (double)SDL_GetPerformanceFrequency();
+                if (run == 0 or ms < best_ms) best_ms = ms;
+            }
+
+            if (level == STBI_SIMD_NONE) scalar_ms = best_ms;
+            std::cout << ' ' << LEVEL_NAMES[level] << ' ' << best_ms << " ms";
+            if (level != STBI_SIMD_NONE) std::cout << " (" << scalar_ms / best_ms << "x)";
+        }
+        std::cout << '\n';
 
-    // STEP 3: Setting our texture filter parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        const stbi_zlib_stats load_stats = stbi_zlib_get_stats();
+        const std::vector<char> stream = png_zlib_stream(encoded);
+        if (stream.empty()) continue;
 
-    // STEP 4: Releasing our file from memory and returning our texture id
-    stbi_image_free(image);
+        std::cout << "  inflate:";
+        double reference_ms = 0.0;
+        for (int fast = 0; fast <= 1; fast++)
+        {
+            stbi_zlib_set_fast_inflate(fast);
+
+            double best_ms = 0.0;
+            int inflated_size = 0;
+            for (int run = 0; run < runs; run++)
+            {
+                Uint64 start = SDL_GetPerformanceCounter();
+                stbi_image_free(stbi_zlib_decode_malloc(stream.data(), (int)stream.size(), &inflated_size));
+                double ms = (double)(SDL_GetPerformanceCounter() - start) * 1000.0 / (double)SDL_GetPerformanceFrequency();
+                if (run == 0 or ms < best_ms) best_ms = ms;
+            }
+
+            if (not fast) reference_ms = best_ms;
+            std::cout << (fast ? " fast " : " reference ") << best_ms << " ms";
+            if (fast) std::cout << " (" << reference_ms / best_ms << "x, " << inflated_size / (best_ms * 1000.0) << " MB/s)";
+        }
+        std::cout << "; in a load " << load_stats.allocations << " allocations, " << load_stats.bytes_copied << " bytes copied\n";
+    }
 
-    return textureID;
+    stbi_set_simd_limit(STBI_SIMD_AVX2);
+    stbi_zlib_set_fast_inflate(1);
+    return 0;
 }
 
 
@@ -166,53 +323,78 @@ void initialise()
         exit(1);
     }
 
+    FramePacer::Mode pacing_mode = g_frame_pacer.set_mode(g_pacing_mode, g_fps_cap);
+    if (pacing_mode != g_pacing_mode)
+    {
+        LOG("Pacing: " << FramePacer::get_mode_name(g_pacing_mode) << " unsupported, using " << FramePacer::get_mode_name(pacing_mode));
+    }
+
 #ifdef _WINDOWS
     glewInit();
 #endif
 
     glViewport(VIEWPORT_X, VIEWPORT_Y, VIEWPORT_WIDTH, VIEWPORT_HEIGHT);
 
+    g_job_system.start(g_thread_count - 1);
+    g_game_state.jobs = &g_job_system;
+
     g_shader_program.load(V_SHADER_PATH, F_SHADER_PATH);
+    g_stream_buffer.load(STREAM_REGION_SIZE, g_persistent_buffers);
+    g_sprite_batch.load(g_shader_program, &g_stream_buffer);
 
-    g_starwars_bg_matrix = glm::mat4(1.0f);
-    g_red_paddle_matrix = glm::mat4(1.0f);
-    g_blue_paddle_matrix = glm::mat4(1.0f);
-    g_ball_matrix = glm::mat4(1.0f);
-    g_ball2_matrix = glm::mat4(1.0f);
-    g_ball3_matrix = glm::mat4(1.0f);
     g_view_matrix = glm::mat4(1.0f);
-    g_start_game_pic_matrix = glm::mat4(1.0f);
-    g_light_side_wins_pic_matrix = glm::mat4(1.0f);
-    g_dark_side_wins_pic_matrix = glm::mat4(1.0f);
     g_projection_matrix = glm::ortho(-5.0f, 5.0f, -3.75f, 3.75f, -1.0f, 1.0f);
 
-    g_shader_program.set_projection_matrix(g_projection_matrix);
-    g_shader_program.set_view_matrix(g_view_matrix);
+    g_shader_program.set_view_projection_matrix(g_projection_matrix * g_view_matrix);
 
-    glUseProgram(g_shader_program.get_program_id());
+    g_shader_program.use();
 
     glClearColor(BG_RED, BG_BLUE, BG_GREEN, BG_OPACITY);
 
-    g_red_paddle_texture_id = load_texture(RED_PADDLE_SPRITE_FILEPATH);
-    g_blue_paddle_texture_id = load_texture(BLUE_PADDLE_SPRITE_FILEPATH);
-    g_starwars_bg_texture_id = load_texture(STARWARS_BG_SPRITE_FILEPATH);
-    g_ball_texture_id = load_texture(BALL_FILEPATH);
-    g_ball2_texture_id = load_texture(BALL_FILEPATH);
-    g_ball3_texture_id = load_texture(BALL_FILEPATH);
-    g_start_game_pic_texture_id = load_texture(START_GAME_PIC_FILEPATH);
-    g_light_side_wins_pic_texture_id = load_texture(LIGHT_SIDE_WINS_PIC_FILEPATH);
-    g_dark_side_wins_pic_texture_id = load_texture(DARK_SIDE_WINS_PIC_FILEPATH);
+    load_sprites();
 
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 }
 
 
+double counter_seconds(Uint64 counter)
+{
+    return (double)counter / (double)SDL_GetPerformanceFrequency();
+}
+
+// Moves a paddle key change onto the performance counter's clock, which
+// is the one the steps are laid out on
+void record_paddle_key(const SDL_KeyboardEvent& key, double ticks_offset, double now)
+{
+    PaddleTimeline::Key paddle_key;
+    switch (key.keysym.scancode)
+    {
+        case SDL_SCANCODE_W:    paddle_key = PaddleTimeline::RED_UP; break;
+        case SDL_SCANCODE_S:    paddle_key = PaddleTimeline::RED_DOWN; break;
+        case SDL_SCANCODE_UP:   paddle_key = PaddleTimeline::BLUE_UP; break;
+        case SDL_SCANCODE_DOWN: paddle_key = PaddleTimeline::BLUE_DOWN; break;
+        default: return;
+    }
+
+    g_paddle_timeline.set_key(paddle_key, key.type == SDL_KEYDOWN, std::min(now, key.timestamp / 1000.0 + ticks_offset));
+}
+
 void process_input()
 {
+    // SDL stamps events in whole milliseconds of SDL_GetTicks()
+    const double now = counter_seconds(SDL_GetPerformanceCounter()),
+        ticks_offset = now - SDL_GetTicks() / 1000.0;
+
     SDL_Event event;
     while (SDL_PollEvent(&event))
     {
+        if (event.type == SDL_KEYDOWN or event.type == SDL_KEYUP)
+        {
+            g_frame_pacer.note_input_event(event.key.timestamp);
+            if (not event.key.repeat) record_paddle_key(event.key, ticks_offset, now);
+        }
+
         switch (event.type)
         {
             case SDL_QUIT:
@@ -224,30 +406,36 @@ void process_input()
                 switch (event.key.keysym.sym)
                 {
                     case SDLK_t:
-                        g_single_player_mode = not g_single_player_mode;
-                        single_player_mode_upwards_ball_direction = g_blue_paddle_movement.y ? g_blue_paddle_movement.y : 1.0f;
+                        g_sim_input.toggle_single_player = not g_sim_input.toggle_single_player;
+                        break;
+
+                    case SDLK_c:
+                        g_sim_input.toggle_ball_collisions = not g_sim_input.toggle_ball_collisions;
                         break;
 
                     case SDLK_1:
-                        show_ball2 = false;
-                        show_ball3 = false;
+                        g_sim_input.ball_count_request = 1;
                         break;
 
                     case SDLK_2:
-                        show_ball2 = true;
-                        show_ball3 = false;
+                        g_sim_input.ball_count_request = 2;
                         break;
 
                     case SDLK_3:
-                        show_ball2 = true;
-                        show_ball3 = true;
+                        g_sim_input.ball_count_request = 3;
                         break;
 
-                    case SDLK_CAPSLOCK:
-                        if (not g_start_game) {
-                            start_game();
-                        }
+                    case SDLK_4:
+                        g_sim_input.ball_count_request = STRESS_BALL_COUNT;
+                        break;
 
+                    case SDLK_5:
+                        g_sim_input.ball_count_request = HEAVY_STRESS_BALL_COUNT;
+                        break;
+
+                    case SDLK_CAPSLOCK:
+                        g_sim_input.start_requested = true;
+                        break;
 
                     default:
                         break;
@@ -256,363 +444,360 @@ void process_input()
         }
     }
 
+    g_frame_pacer.mark_input_sampled();
     const Uint8* key_state = SDL_GetKeyboardState(NULL);
 
+    const bool paddle_keys_down[PaddleTimeline::KEY_COUNT] = {
+        key_state[SDL_SCANCODE_W] != 0, key_state[SDL_SCANCODE_S] != 0,
+        key_state[SDL_SCANCODE_UP] != 0, key_state[SDL_SCANCODE_DOWN] != 0
+    };
+    g_paddle_timeline.sync(paddle_keys_down, now);
+
     if (key_state[SDL_SCANCODE_W])
     {
-        g_red_paddle_movement.y = 1.0f;
+        g_sim_input.red_paddle_direction = 1.0f;
     }
     else if (key_state[SDL_SCANCODE_S])
     {   
-        g_red_paddle_movement.y = -1.0f;
+        g_sim_input.red_paddle_direction = -1.0f;
     }
 
     if (not (key_state[SDL_SCANCODE_W] xor key_state[SDL_SCANCODE_S]))
     {
-        g_red_paddle_movement.y = 0.0f;
+        g_sim_input.red_paddle_direction = 0.0f;
     }
     
 
     if (key_state[SDL_SCANCODE_UP])
     {
-        g_blue_paddle_movement.y = 1.0f;
+        g_sim_input.blue_paddle_direction = 1.0f;
     }
     else if (key_state[SDL_SCANCODE_DOWN]) 
     {
-        g_blue_paddle_movement.y = -1.0f;
+        g_sim_input.blue_paddle_direction = -1.0f;
     }
 
     if (not (key_state[SDL_SCANCODE_UP] xor key_state[SDL_SCANCODE_DOWN]))
     {
-        g_blue_paddle_movement.y = 0.0f;
+        g_sim_input.blue_paddle_direction = 0.0f;
     }
 }
-constexpr float g_paddles_height_limit = 2.5f;
-void update()
-{
-    /* load bg */
-    g_starwars_bg_matrix = glm::mat4(1.0f);
-    g_starwars_bg_matrix = glm::scale(g_starwars_bg_matrix, INIT_STARWARS_BG_SCALE);
-
-    /* Delta time calculations */
-    float ticks = (float)SDL_GetTicks() / MILLISECONDS_IN_SECOND;
-    float delta_time = ticks - g_previous_ticks;
-    g_previous_ticks = ticks;
-
-    /* Game logic */
 
-    if (g_start_game) {
-        g_ball_speed += 0.000001 * ticks;
+void finish_replay()
+{
+    LOG("Replay finished after " << g_input_replay.get_frame_count() << " frames");
+    if (g_input_replay.has_checksum())
+    {
+        bool matches = state_checksum(g_game_state) == g_input_replay.get_final_checksum();
+        LOG((matches ? "Final state matches the recording" : "Final state DIFFERS from the recording"));
     }
+    g_app_status = TERMINATED;
+}
 
-    /* Model matrix reset */
-    g_red_paddle_matrix = glm::mat4(1.0f);
-    g_blue_paddle_matrix = glm::mat4(1.0f);
-
-    /* Transformations */
-
-    /* RED PADDLE STUFF */
-
-
-    g_red_paddle_position += g_red_paddle_movement * g_paddle_speed * delta_time;
-
-    /* making sure red paddle doesn't go off window */
-    if (g_red_paddle_position.y > g_paddles_height_limit) {
-        g_red_paddle_position.y = g_paddles_height_limit;
-    }
+void update()
+{
+    /* Delta time calculations */
+    Uint64 counter = SDL_GetPerformanceCounter();
+    double frame_time = (double)(counter - g_previous_counter) / (double)SDL_GetPerformanceFrequency();
+    g_previous_counter = counter;
 
-    else if (g_red_paddle_position.y < -g_paddles_height_limit) {
-        g_red_paddle_position.y = -g_paddles_height_limit;
-    }
+    if (frame_time > MAX_FRAME_TIME) frame_time = MAX_FRAME_TIME;
 
-    g_red_paddle_matrix = glm::translate(g_red_paddle_matrix, g_red_paddle_position);
-    g_red_paddle_matrix = glm::scale(g_red_paddle_matrix, INIT_SCALE);
+    InputFrame frame;
+    StepInputHook before_step;
 
-    /* BLUE PADDLE STUFF */
-    if (g_single_player_mode) {
-        g_blue_paddle_position.y += g_paddle_speed * delta_time * single_player_mode_upwards_ball_direction;
-        if (g_blue_paddle_position.y == g_paddles_height_limit) {
-            single_player_mode_upwards_ball_direction = -1;
-        }
-        else if (g_blue_paddle_position.y == -g_paddles_height_limit) {
-            single_player_mode_upwards_ball_direction = 1;
+    /* Replay */
+    if (g_input_replay.is_loaded())
+    {
+        if (not g_input_replay.next(frame))
+        {
+            finish_replay();
+            return;
         }
-    }
 
-    else {
-        g_blue_paddle_position += g_blue_paddle_movement * g_paddle_speed * delta_time;
+        // Hold each frame for as long as it originally took
+        if (not g_replay_fast and frame_time < frame.frame_time)
+        {
+            SDL_Delay((Uint32)((frame.frame_time - frame_time) * 1000.0));
+            g_previous_counter = SDL_GetPerformanceCounter();
+        }
 
+        g_sim_input = frame.input;
+        frame_time = frame.frame_time;
+        before_step = step_directions_hook(frame);
     }
-
-    /* making sure blue paddle doesn't go off window */
-    if (g_blue_paddle_position.y > g_paddles_height_limit) {
-        g_blue_paddle_position.y = g_paddles_height_limit;
+    else if (g_timestamped_input)
+    {
+        // This frame's steps pick up where the last frame's left off, so
+        // step i covers its own slice of wall time
+        const double steps_start = counter_seconds(counter) - (g_accumulator + frame_time);
+        before_step = [steps_start](int step, SimInput& input)
+        {
+            const double step_start = steps_start + step * (double)g_fixed_timestep;
+            g_paddle_timeline.integrate(step_start, step_start + g_fixed_timestep,
+                input.red_paddle_direction, input.blue_paddle_direction);
+        };
     }
 
-    else if (g_blue_paddle_position.y < -g_paddles_height_limit) {
-        g_blue_paddle_position.y = -g_paddles_height_limit;
-    }
+    InputFrame recorded;
+    recorded.frame_time = frame_time;
+    recorded.input = g_sim_input;
 
-    g_blue_paddle_matrix = glm::translate(g_blue_paddle_matrix, g_blue_paddle_position);
+    /* Game logic */
+    // Key presses are one-shot; held paddle keys are resampled every frame,
+    // or integrated per step by before_step
+    advance(g_game_state, g_sim_input, g_accumulator, frame_time, g_fixed_timestep, [&](int step, SimInput& input)
+    {
+        if (not before_step) return;
 
-    g_blue_paddle_matrix = glm::scale(g_blue_paddle_matrix, INIT_SCALE);
+        before_step(step, input);
+        if (g_input_recorder.is_open())
+        {
+            recorded.step_directions.push_back(input.red_paddle_direction);
+            recorded.step_directions.push_back(input.blue_paddle_direction);
+        }
+    });
 
+    if (g_input_recorder.is_open()) g_input_recorder.record(recorded);
+}
 
-    /* BALL STUFF */
-    g_ball_matrix = glm::mat4(1.0f);
+// Moves the paddle transforms and packs every ball transform for this frame,
+// blending the last two simulation steps by alpha so motion stays smooth
+// whatever the render rate
+void build_transforms(float alpha)
+{
+    g_red_paddle_transform.set_position(glm::mix(g_game_state.previous_red_paddle_position, g_game_state.red_paddle_position, alpha));
+    g_blue_paddle_transform.set_position(glm::mix(g_game_state.previous_blue_paddle_position, g_game_state.blue_paddle_position, alpha));
 
-    float red_paddle_x_distance = fabs(g_ball_position.x - g_red_paddle_position.x) - ((g_paddle_width + g_ball_width) / 2.0f);
-    float red_paddle_y_distance = fabs(g_ball_position.y - g_red_paddle_position.y) - ((g_paddle_height + g_ball_width) / 2.0f);
+    const BallPool& balls = g_game_state.balls;
+    g_ball_transforms.resize(g_game_state.ball_count);
+    g_job_system.parallel_for(g_ball_transforms.size(), BALLS_PER_JOB, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            float ball_x = balls.previous_x[i] + (balls.x[i] - balls.previous_x[i]) * alpha,
+                ball_y = balls.previous_y[i] + (balls.y[i] - balls.previous_y[i]) * alpha;
 
-    if (red_paddle_x_distance < 0 and red_paddle_y_distance < 0) {
-        g_ball_movement.x = 1.0f;
-    }
+            g_ball_transforms[i] = glm::vec4(ball_x, ball_y, INIT_BALL_SCALE.x, INIT_BALL_SCALE.y);
+        }
+    });
+}
 
-    float blue_paddle_x_distance = fabs(g_ball_position.x - g_blue_paddle_position.x) - ((g_paddle_width + g_ball_width) / 2.0f);
-    float blue_paddle_y_distance = fabs(g_ball_position.y - g_blue_paddle_position.y) - ((g_paddle_height + g_ball_width) / 2.0f);
+// Re-reads the paddle keys just before drawing and shows each player's
+// paddle where the freshest input takes it. It starts from the same blend of
+// the last two steps as the balls, so both are drawn at one moment, and moves
+// on by the freshest direction over the time left in the accumulator. Only
+// the drawing changes; the next steps still integrate the timestamped keys.
+void late_latch_paddles(float alpha)
+{
+    SDL_PumpEvents();
+    g_frame_pacer.mark_input_latched();
 
-    if (blue_paddle_x_distance < 0 and blue_paddle_y_distance < 0) {
-        g_ball_movement.x = -1.0f;
-    }
+    const double now = counter_seconds(SDL_GetPerformanceCounter()),
+        ticks_offset = now - SDL_GetTicks() / 1000.0;
 
-    if (g_ball_position.x > 4.0f + 1.0f) {
-        g_dark_side_won = true;
-        reset_game();
-    }
-    else if (g_ball_position.x < -4.0f - 1.0f) {
-        g_light_side_won = true;
-        reset_game();
+    // Left in the queue for process_input(), which records them again; the
+    // timeline treats a change to the state a key is already in as a no-op
+    SDL_Event events[16];
+    int event_count = SDL_PeepEvents(events, 16, SDL_PEEKEVENT, SDL_KEYDOWN, SDL_KEYUP);
+    for (int i = 0; i < event_count; i++)
+    {
+        g_frame_pacer.note_input_event(events[i].key.timestamp);
+        if (not events[i].key.repeat) record_paddle_key(events[i].key, ticks_offset, now);
     }
 
+    const float lead = g_paddle_speed * (float)g_accumulator;
 
-    if (g_ball_position.y > g_paddles_height_limit) {
-        g_ball_movement.y = -1.0f;
-    }
-    else if (g_ball_position.y < -g_paddles_height_limit) {
-        g_ball_movement.y = 1.0f;
-    }
-
-    if (g_start_game) {
-        g_ball_position += g_ball_movement * g_ball_speed * delta_time;
-        g_ball_matrix = glm::translate(g_ball_matrix, g_ball_position);
-    }
-    
+    glm::vec3 red_position = glm::mix(g_game_state.previous_red_paddle_position, g_game_state.red_paddle_position, alpha);
+    red_position.y += g_paddle_timeline.get_latest_direction(PaddleTimeline::RED_UP, PaddleTimeline::RED_DOWN) * lead;
+    red_position.y = std::max(-g_paddles_height_limit, std::min(red_position.y, g_paddles_height_limit));
+    g_red_paddle_transform.set_position(red_position);
 
-    g_ball_matrix = glm::scale(g_ball_matrix, INIT_BALL_SCALE);
+    // The bot drives blue in single player
+    if (g_game_state.single_player_mode) return;
 
-    /* BALL2 STUFF */
+    glm::vec3 blue_position = glm::mix(g_game_state.previous_blue_paddle_position, g_game_state.blue_paddle_position, alpha);
+    blue_position.y += g_paddle_timeline.get_latest_direction(PaddleTimeline::BLUE_UP, PaddleTimeline::BLUE_DOWN) * lead;
+    blue_position.y = std::max(-g_paddles_height_limit, std::min(blue_position.y, g_paddles_height_limit));
+    g_blue_paddle_transform.set_position(blue_position);
+}
 
-    g_ball2_matrix = glm::mat4(1.0f);
+void render()
+{
+    const float alpha = (float)(g_accumulator / g_fixed_timestep);
+    build_transforms(alpha);
+    if (g_late_latch and not g_input_replay.is_loaded()) late_latch_paddles(alpha);
 
-    float red_paddle_x_distance2 = fabs(g_ball2_position.x - g_red_paddle_position.x) - ((g_paddle_width + g_ball_width) / 2.0f);
-    float red_paddle_y_distance2 = fabs(g_ball2_position.y - g_red_paddle_position.y) - ((g_paddle_height + g_ball_width) / 2.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
 
-    if (red_paddle_x_distance2 < 0 and red_paddle_y_distance2 < 0) {
-        g_ball2_movement.x = 1.0f;
-    }
+    g_shader_program.reset_stats();
+    g_shader_program.use();
 
-    float blue_paddle_x_distance2 = fabs(g_ball2_position.x - g_blue_paddle_position.x) - ((g_paddle_width + g_ball_width) / 2.0f);
-    float blue_paddle_y_distance2 = fabs(g_ball2_position.y - g_blue_paddle_position.y) - ((g_paddle_height + g_ball_width) / 2.0f);
+    // The quad and its attributes live in the sprite batch's vertex array
+    g_stream_buffer.begin_frame();
 
-    if (blue_paddle_x_distance2 < 0 and blue_paddle_y_distance2 < 0) {
-        g_ball2_movement.x = -1.0f;
-    }
+    // Queue every sprite, then draw them all in as few calls as possible
+    g_sprite_batch.begin();
 
-    if (g_ball2_position.x > 4.0f + 1.0f) {
-        g_dark_side_won = true;
+    g_sprite_batch.draw(g_starwars_bg_transform.get_sprite_transform(), g_starwars_bg_sprite);
+    g_sprite_batch.draw(g_red_paddle_transform.get_sprite_transform(), g_red_paddle_sprite);
+    g_sprite_batch.draw(g_blue_paddle_transform.get_sprite_transform(), g_blue_paddle_sprite);
 
-        reset_game();
-    }
-    else if (g_ball2_position.x < -4.0f - 1.0f) {
-        g_light_side_won = true;
-        reset_game();
+    for (const glm::vec4& ball_transform : g_ball_transforms)
+    {
+        g_sprite_batch.draw(ball_transform, g_ball_sprite);
     }
 
-    if (g_ball2_position.y > g_paddles_height_limit) {
-        g_ball2_movement.y = -1.0f;
-    }
-    else if (g_ball2_position.y < -g_paddles_height_limit) {
-        g_ball2_movement.y = 1.0f;
+    if (!g_game_state.start_game) {
+        if (!g_game_state.dark_side_won and !g_game_state.light_side_won) {
+            g_sprite_batch.draw(g_start_game_pic_transform.get_sprite_transform(), g_start_game_pic_sprite);
+        }
+        else if (g_game_state.dark_side_won) {
+            g_sprite_batch.draw(g_dark_side_wins_pic_transform.get_sprite_transform(), g_dark_side_wins_pic_sprite);
+        }
+        else if (g_game_state.light_side_won) {
+            g_sprite_batch.draw(g_light_side_wins_pic_transform.get_sprite_transform(), g_light_side_wins_pic_sprite);
+        }
     }
 
-    if (show_ball2) {
-        g_ball2_position += g_ball2_movement * g_ball_speed * delta_time;
-        g_ball2_matrix = glm::translate(g_ball2_matrix, g_ball2_position);
-    }
-    
+    g_sprite_batch.end();
+    g_stream_buffer.end_frame();
+}
 
-    g_ball2_matrix = glm::scale(g_ball2_matrix, INIT_BALL_SCALE);
+void report_timings()
+{
+    if (g_timings_interval <= 0.0) return;
 
-    /* BALL3 STUFF */
+    Uint64 counter = SDL_GetPerformanceCounter();
+    if ((double)(counter - g_last_timings_report) / (double)SDL_GetPerformanceFrequency() < g_timings_interval) return;
+    g_last_timings_report = counter;
 
-    g_ball3_matrix = glm::mat4(1.0f);
+    LOG("Frame timings over the last " << g_frame_profiler.get_summary(FrameProfiler::FRAME).samples << " frames:\n"
+        << g_frame_profiler.format_summary() << g_frame_pacer.format_summary());
+}
 
-    float red_paddle_x_distance3 = fabs(g_ball3_position.x - g_red_paddle_position.x) - ((g_paddle_width + g_ball_width) / 2.0f);
-    float red_paddle_y_distance3 = fabs(g_ball3_position.y - g_red_paddle_position.y) - ((g_paddle_height + g_ball_width) / 2.0f);
 
-    if (red_paddle_x_distance3 < 0 and red_paddle_y_distance3 < 0) {
-        g_ball3_movement.x = 1.0f;
+void shutdown()
+{
+    if (g_input_recorder.is_open())
+    {
+        LOG("Recorded " << g_input_recorder.get_frame_count() << " frames");
+        g_input_recorder.close(state_checksum(g_game_state));
     }
 
-    float blue_paddle_x_distance3 = fabs(g_ball3_position.x - g_blue_paddle_position.x) - ((g_paddle_width + g_ball_width) / 2.0f);
-    float blue_paddle_y_distance3 = fabs(g_ball3_position.y - g_blue_paddle_position.y) - ((g_paddle_height + g_ball_width) / 2.0f);
+    const SpriteBatch::Stats& stats = g_sprite_batch.get_stats();
+    LOG("Last frame: " << stats.sprites << " sprites, " << stats.draw_calls << " draw calls, "
+        << stats.texture_binds << " texture binds, " << stats.buffer_uploads << " buffer uploads, "
+        << stats.attribute_pointer_changes << " attribute pointer changes");
 
-    if (blue_paddle_x_distance3 < 0 and blue_paddle_y_distance3 < 0) {
-        g_ball3_movement.x = -1.0f;
-    }
+    const StreamBuffer::Stats& stream_stats = g_stream_buffer.get_stats();
+    LOG("Last frame: " << stream_stats.bytes_written << " bytes streamed in " << stream_stats.writes << " writes ("
+        << (stream_stats.persistent ? "persistent" : "unsynchronized") << " mapping), "
+        << stream_stats.overflows << " overflows, " << stream_stats.fence_waits << " fence waits");
 
-    if (g_ball3_position.x > 4.0f + 1.0f) {
-        g_dark_side_won = true;
-        reset_game();
-    }
-    else if (g_ball3_position.x < -4.0f - 1.0f) {
-        g_light_side_won = true;
-        reset_game();
-    }
+    const ShaderProgram::Stats& shader_stats = g_shader_program.get_stats();
+    LOG("Last frame: " << shader_stats.program_binds_issued << " program binds issued, "
+        << shader_stats.program_binds_skipped << " skipped; " << shader_stats.uniform_uploads_issued
+        << " uniform uploads issued, " << shader_stats.uniform_uploads_skipped << " skipped");
 
-    if (g_ball3_position.y > g_paddles_height_limit) {
-        g_ball3_movement.y = -1.0f;
-    }
-    else if (g_ball3_position.y < -g_paddles_height_limit) {
-        g_ball3_movement.y = 1.0f;
-    }
+    LOG("Frame timings over the last " << g_frame_profiler.get_summary(FrameProfiler::FRAME).samples << " of "
+        << g_frame_profiler.get_frame_count() << " frames:\n" << g_frame_profiler.format_summary()
+        << g_frame_pacer.format_summary());
 
-    if (show_ball3) {
-        g_ball3_position += g_ball3_movement * g_ball_speed * delta_time;
-        g_ball3_matrix = glm::translate(g_ball3_matrix, g_ball3_position);
+    if (g_timings_csv_filepath and not g_frame_profiler.write_csv(g_timings_csv_filepath))
+    {
+        LOG("Unable to write " << g_timings_csv_filepath);
+    }
+    if (g_timings_json_filepath and not g_frame_profiler.write_json(g_timings_json_filepath))
+    {
+        LOG("Unable to write " << g_timings_json_filepath);
     }
 
-
-    g_ball3_matrix = glm::scale(g_ball3_matrix, INIT_BALL_SCALE);
-
-    /* PICTURE STUFF */
-
-    g_start_game_pic_matrix = glm::mat4(1.0f);
-    g_start_game_pic_matrix = glm::scale(g_start_game_pic_matrix, glm::vec3(10.0f, 5.0f, 0.0f));
-    g_light_side_wins_pic_matrix = glm::mat4(1.0f);
-    g_light_side_wins_pic_matrix = glm::scale(g_light_side_wins_pic_matrix, glm::vec3(10.0f, 5.0f, 0.0f));
-    g_dark_side_wins_pic_matrix = glm::mat4(1.0f);
-    g_dark_side_wins_pic_matrix = glm::scale(g_dark_side_wins_pic_matrix, glm::vec3(10.0f, 5.0f, 0.0f));
-
-
-}
-
-void reset_game() {
-    g_start_game = false;
-    g_red_paddle_position = glm::vec3(-4.0f, 0.0f, 0.0f);
-    g_red_paddle_movement = glm::vec3(0.0f, 0.0f, 0.0f);
-    g_blue_paddle_position = glm::vec3(4.0f, 0.0f, 0.0f);
-    g_blue_paddle_movement = glm::vec3(0.0f, 0.0f, 0.0f);
-    g_ball_position = glm::vec3(0.0f, 0.0f, 0.0f);
-    g_ball_movement = glm::vec3(0.0f, 0.0f, 0.0f);
-    g_ball2_position = glm::vec3(0.0f, 0.0f, 0.0f);
-    g_ball2_movement = glm::vec3(0.0f, 0.0f, 0.0f);
-    g_ball3_position = glm::vec3(0.0f, 0.0f, 0.0f);
-    g_ball3_movement = glm::vec3(0.0f, 0.0f, 0.0f);
-    g_ball_speed = 1.0f;
-    
-}
-
-void start_game() {
-    g_start_game = true;
-    g_dark_side_won = false;
-    g_light_side_won = false;
-    g_red_paddle_position = glm::vec3(-4.0f, 0.0f, 0.0f);
-    g_red_paddle_movement = glm::vec3(0.0f, 0.0f, 0.0f);
-    g_blue_paddle_position = glm::vec3(4.0f, 0.0f, 0.0f);
-    g_blue_paddle_movement = glm::vec3(0.0f, 0.0f, 0.0f);
-    g_ball_position = glm::vec3(0.0f, 0.0f, 0.0f);
-    g_ball_movement = glm::vec3(-1.0f, 1.0f, 0.0f);
-    g_ball2_position = glm::vec3(0.0f, 0.0f, 0.0f);
-    g_ball2_movement = glm::vec3(1.0f, 1.0f, 0.0f);
-    g_ball3_position = glm::vec3(0.0f, 0.0f, 0.0f);
-    g_ball3_movement = glm::vec3(-1.0f, -1.0f, 0.0f);
-}
-
-void draw_object(glm::mat4& object_g_model_matrix, GLuint& object_texture_id)
-{
-    g_shader_program.set_model_matrix(object_g_model_matrix);
-    glBindTexture(GL_TEXTURE_2D, object_texture_id);
-    glDrawArrays(GL_TRIANGLES, 0, 6); // we are now drawing 2 triangles, so use 6, not 3
+    SDL_Quit();
 }
 
 
-void render()
+int main(int argc, char* argv[])
 {
-    glClear(GL_COLOR_BUFFER_BIT);
-
-    // Vertices
-    float vertices[] =
+    if (headless_requested(argc, argv))
     {
-        -0.5f, -0.5f, 0.5f, -0.5f, 0.5f, 0.5f,  // triangle 1
-        -0.5f, -0.5f, 0.5f, 0.5f, -0.5f, 0.5f   // triangle 2
-    };
+        return run_headless(argc, argv);
+    }
 
-    // Textures
-    float texture_coordinates[] =
+    if (has_flag(argc, argv, "--cook"))
     {
-        0.0f, 1.0f, 1.0f, 1.0f, 1.0f, 0.0f,     // triangle 1
-        0.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f,     // triangle 2
-    };
-
-    glVertexAttribPointer(g_shader_program.get_position_attribute(), 2, GL_FLOAT, false,
-        0, vertices);
-    glEnableVertexAttribArray(g_shader_program.get_position_attribute());
-
-    glVertexAttribPointer(g_shader_program.get_tex_coordinate_attribute(), 2, GL_FLOAT,
-        false, 0, texture_coordinates);
-    glEnableVertexAttribArray(g_shader_program.get_tex_coordinate_attribute());
-
-    // Bind texture
-    draw_object(g_starwars_bg_matrix, g_starwars_bg_texture_id);
-    draw_object(g_red_paddle_matrix, g_red_paddle_texture_id);
-    draw_object(g_blue_paddle_matrix, g_blue_paddle_texture_id);
-
-    draw_object(g_ball_matrix, g_ball_texture_id);
-
+        return cook_sprites(argc, argv);
+    }
 
-    if (show_ball2) {
-        draw_object(g_ball2_matrix, g_ball2_texture_id);
+    if (has_flag(argc, argv, "--bench-decode"))
+    {
+        return bench_decode(argc, argv);
     }
 
-    if (show_ball3) {
-        draw_object(g_ball3_matrix, g_ball3_texture_id);
+    if (const char* value = find_option(argc, argv, "--timings-interval")) g_timings_interval = atof(value);
+    g_timings_csv_filepath = find_option(argc, argv, "--timings-csv");
+    g_timings_json_filepath = find_option(argc, argv, "--timings-json");
+    if (const char* value = find_option(argc, argv, "--fps-cap"))
+    {
+        g_fps_cap = atof(value);
+        g_pacing_mode = FramePacer::CAPPED;
+    }
+    if (const char* value = find_option(argc, argv, "--pacing"))
+    {
+        if (not FramePacer::parse_mode(value, g_pacing_mode)) LOG("Unknown pacing mode " << value << ", using " << FramePacer::get_mode_name(g_pacing_mode));
     }
+    if (g_fps_cap <= 0.0) g_fps_cap = FramePacer::DEFAULT_FPS_CAP;
 
-    if (!g_start_game) {
-        if (!g_dark_side_won and !g_light_side_won) {
-            draw_object(g_start_game_pic_matrix, g_start_game_pic_texture_id);
-        }
-        else if (g_dark_side_won) {
-            draw_object(g_dark_side_wins_pic_matrix, g_dark_side_wins_pic_texture_id);
+    g_persistent_buffers = not has_flag(argc, argv, "--no-persistent-map");
+    if (const char* value = find_option(argc, argv, "--threads")) g_thread_count = (unsigned)std::max(1, atoi(value));
+    g_timestamped_input = not has_flag(argc, argv, "--frame-input");
+    g_late_latch = has_flag(argc, argv, "--late-latch");
+
+    if (const char* filepath = find_option(argc, argv, "--replay"))
+    {
+        if (not g_input_replay.load(filepath))
+        {
+            LOG("Unable to load replay " << filepath);
+            return 1;
         }
-        else if (g_light_side_won) {
-            draw_object(g_light_side_wins_pic_matrix, g_light_side_wins_pic_texture_id);
+        g_fixed_timestep = g_input_replay.get_fixed_timestep();
+        g_replay_fast = has_flag(argc, argv, "--replay-fast");
+    }
+    else if (const char* filepath = find_option(argc, argv, "--record"))
+    {
+        if (not g_input_recorder.open(filepath, g_fixed_timestep))
+        {
+            LOG("Unable to write " << filepath);
+            return 1;
         }
     }
 
-
-
-    // We disable two attribute arrays now
-    glDisableVertexAttribArray(g_shader_program.get_position_attribute());
-    glDisableVertexAttribArray(g_shader_program.get_tex_coordinate_attribute());
-
-    SDL_GL_SwapWindow(g_display_window);
-}
-
-
-void shutdown() { SDL_Quit(); }
-
-
-int main(int argc, char* argv[])
-{
     initialise();
+    g_previous_counter = SDL_GetPerformanceCounter();
+    g_last_timings_report = g_previous_counter;
 
     while (g_app_status == RUNNING)
     {
+        g_frame_profiler.begin_frame();
+
+        g_frame_pacer.wait_for_next_frame();
+        g_frame_profiler.mark(FrameProfiler::PACE);
+
         process_input();
+        g_frame_profiler.mark(FrameProfiler::INPUT);
+
         update();
+        g_frame_profiler.mark(FrameProfiler::UPDATE);
+
         render();
+        g_frame_profiler.mark(FrameProfiler::RENDER);
+
+        SDL_GL_SwapWindow(g_display_window);
+        g_frame_pacer.mark_presented();
+        g_frame_profiler.mark(FrameProfiler::SWAP);
+
+        g_frame_profiler.end_frame();
+        report_timings();
     }
 
     shutdown();
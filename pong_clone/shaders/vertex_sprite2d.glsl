@@ -0,0 +1,24 @@
+attribute vec4 position;
+attribute vec2 texCoord;
+
+// Per-instance: (centre x, centre y, width, height), rotation in radians
+// about the centre, and the (offset, size) of the sprite's UV rect
+attribute vec4 instanceTransform;
+attribute float instanceRotation;
+attribute vec4 instanceUV;
+
+// projection * view, multiplied once on the CPU
+uniform mat4 viewProjectionMatrix;
+
+varying vec2 texCoordVar;
+
+void main()
+{
+    vec2 scaled = position.xy * instanceTransform.zw;
+    float c = cos(instanceRotation);
+    float s = sin(instanceRotation);
+    vec2 world = instanceTransform.xy + vec2(c * scaled.x - s * scaled.y, s * scaled.x + c * scaled.y);
+
+    texCoordVar = instanceUV.xy + texCoord * instanceUV.zw;
+    gl_Position = viewProjectionMatrix * vec4(world, 0.0, 1.0);
+}
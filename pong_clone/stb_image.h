@@ -442,6 +442,22 @@ STBIDEF stbi_uc *stbi_load_from_file  (FILE *f,                  int *x, int *y,
 // for stbi_load_from_file, file pointer is left pointing immediately after image
 #endif
 
+// decode into caller memory instead of a fresh allocation: dst holds
+// dst_h rows of dst_stride bytes, each with room for dst_w pixels of
+// req_comp (1..4) channels. the image lands in the top-left corner and
+// nothing outside its x*y pixels is written. returns 0, writing nothing,
+// if the image is bigger than dst_w x dst_h; use stbi_info to size dst.
+// 8-bit non-interlaced PNGs without palette or tRNS, and JPEGs with
+// req_comp other than 3, are decoded in place; other images go through
+// a temporary buffer.
+STBIDEF int stbi_load_into               (char              const *filename,           stbi_uc *dst, int dst_stride, int dst_w, int dst_h, int *x, int *y, int *comp, int req_comp);
+STBIDEF int stbi_load_from_memory_into   (stbi_uc           const *buffer, int len   , stbi_uc *dst, int dst_stride, int dst_w, int dst_h, int *x, int *y, int *comp, int req_comp);
+STBIDEF int stbi_load_from_callbacks_into(stbi_io_callbacks const *clbk  , void *user, stbi_uc *dst, int dst_stride, int dst_w, int dst_h, int *x, int *y, int *comp, int req_comp);
+
+#ifndef STBI_NO_STDIO
+STBIDEF int stbi_load_from_file_into  (FILE *f,                  stbi_uc *dst, int dst_stride, int dst_w, int dst_h, int *x, int *y, int *comp, int req_comp);
+#endif
+
 #ifndef STBI_NO_LINEAR
    STBIDEF float *stbi_loadf                 (char const *filename,           int *x, int *y, int *comp, int req_comp);
    STBIDEF float *stbi_loadf_from_memory     (stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp);
@@ -502,6 +518,21 @@ STBIDEF void stbi_convert_iphone_png_to_rgb(int flag_true_if_should_convert);
 // flip the image vertically, so the first pixel in the output array is the bottom left
 STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip);
 
+// caps the x86 SIMD kernels picked at runtime, e.g. to benchmark or test
+// against the scalar code. the default is the best the CPU supports. the
+// limit is one plain global: set it before any other thread starts a decode.
+// with STBI_NO_THREAD_LOCALS the detected level is one too, so also call
+// stbi_get_simd_level() once before starting those threads.
+enum
+{
+   STBI_SIMD_NONE,
+   STBI_SIMD_SSE2,
+   STBI_SIMD_SSSE3,
+   STBI_SIMD_AVX2
+};
+STBIDEF void stbi_set_simd_limit(int level);
+STBIDEF int  stbi_get_simd_level(void); // what the limit and CPU allow
+
 // ZLIB client - used by PNG, available for other purposes
 
 STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int initial_size, int *outlen);
@@ -512,6 +543,22 @@ STBIDEF int   stbi_zlib_decode_buffer(char *obuffer, int olen, const char *ibuff
 STBIDEF char *stbi_zlib_decode_noheader_malloc(const char *buffer, int len, int *outlen);
 STBIDEF int   stbi_zlib_decode_noheader_buffer(char *obuffer, int olen, const char *ibuffer, int ilen);
 
+// turning this off decodes one huffman symbol at a time and copies matches
+// byte by byte, e.g. to benchmark or test the fast inflate loop against it.
+// the default is on. like the SIMD limit this is one plain global: set it
+// before any other thread starts a decode.
+STBIDEF void stbi_zlib_set_fast_inflate(int flag_true_if_fast);
+
+// counters for the calling thread's most recent zlib decode, including the
+// one inside a PNG load. a decode into a caller's buffer allocates nothing;
+// bytes_copied is the decoded output each reallocation had to move.
+typedef struct
+{
+   int allocations;
+   int bytes_copied;
+} stbi_zlib_stats;
+STBIDEF stbi_zlib_stats stbi_zlib_get_stats(void);
+
 
 #ifdef __cplusplus
 }
@@ -597,12 +644,14 @@ typedef unsigned short stbi__uint16;
 typedef   signed short stbi__int16;
 typedef unsigned int   stbi__uint32;
 typedef   signed int   stbi__int32;
+typedef unsigned __int64 stbi__uint64;
 #else
 #include <stdint.h>
 typedef uint16_t stbi__uint16;
 typedef int16_t  stbi__int16;
 typedef uint32_t stbi__uint32;
 typedef int32_t  stbi__int32;
+typedef uint64_t stbi__uint64;
 #endif
 
 // should produce compiler error if size is wrong
@@ -724,6 +773,87 @@ static int stbi__sse2_available()
 #endif
 #endif
 
+// SSSE3 and AVX2 kernels are compiled per function, so the rest of the
+// file still only assumes SSE2, and used only when cpuid reports them.
+// define STBI_NO_AVX2 to leave them out.
+#if defined(STBI_SSE2) && !defined(STBI_NO_AVX2)
+#if defined(_MSC_VER) && _MSC_VER >= 1700
+#define STBI__X86_DISPATCH
+#define STBI__TARGET_SSSE3
+#define STBI__TARGET_AVX2
+#elif defined(__clang__) || (defined(__GNUC__) && (__GNUC__ * 100 + __GNUC_MINOR__) >= 409)
+#define STBI__X86_DISPATCH
+#define STBI__TARGET_SSSE3 __attribute__((target("ssse3")))
+#define STBI__TARGET_AVX2  __attribute__((target("avx2")))
+#endif
+#endif
+
+#ifdef STBI__X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+// each thread keeps its own failure reason and detected SIMD level so images
+// can be decoded concurrently; define STBI_NO_THREAD_LOCALS to fall back to
+// one global of each
+#ifndef STBI_NO_THREAD_LOCALS
+   #if defined(__cplusplus) && __cplusplus >= 201103L
+      #define STBI_THREAD_LOCAL       thread_local
+   #elif defined(_MSC_VER)
+      #define STBI_THREAD_LOCAL       __declspec(thread)
+   #elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+      #define STBI_THREAD_LOCAL       _Thread_local
+   #elif defined(__GNUC__)
+      #define STBI_THREAD_LOCAL       __thread
+   #endif
+#endif
+
+// set by stbi_set_simd_limit() before any thread starts decoding
+static int stbi__simd_limit = STBI_SIMD_AVX2;
+
+// filled in by each thread's first decode
+#ifdef STBI_THREAD_LOCAL
+static STBI_THREAD_LOCAL int stbi__detected_simd_level = -1;
+#else
+static int stbi__detected_simd_level = -1;
+#endif
+
+static int stbi__detect_simd_level(void)
+{
+   int level = STBI_SIMD_NONE;
+#ifdef STBI_SSE2
+   if (stbi__sse2_available()) level = STBI_SIMD_SSE2;
+#endif
+#ifdef STBI__X86_DISPATCH
+   #ifdef _MSC_VER
+   {
+      int info[4];
+      __cpuid(info, 1);
+      if (level == STBI_SIMD_SSE2 && (info[2] & (1 << 9))) level = STBI_SIMD_SSSE3;
+      // AVX2 also needs the OS to save the ymm registers
+      if (level == STBI_SIMD_SSSE3 && (info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6) {
+         __cpuidex(info, 7, 0);
+         if (info[1] & (1 << 5)) level = STBI_SIMD_AVX2;
+      }
+   }
+   #else
+   if (level == STBI_SIMD_SSE2 && __builtin_cpu_supports("ssse3")) level = STBI_SIMD_SSSE3;
+   if (level == STBI_SIMD_SSSE3 && __builtin_cpu_supports("avx2")) level = STBI_SIMD_AVX2;
+   #endif
+#endif
+   return level;
+}
+
+STBIDEF void stbi_set_simd_limit(int level)
+{
+   stbi__simd_limit = level;
+}
+
+STBIDEF int stbi_get_simd_level(void)
+{
+   if (stbi__detected_simd_level < 0) stbi__detected_simd_level = stbi__detect_simd_level();
+   return stbi__detected_simd_level < stbi__simd_limit ? stbi__detected_simd_level : stbi__simd_limit;
+}
+
 // ARM NEON
 #if defined(STBI_NO_SIMD) && defined(STBI_NEON)
 #undef STBI_NEON
@@ -759,6 +889,11 @@ typedef struct
 
    stbi_uc *img_buffer, *img_buffer_end;
    stbi_uc *img_buffer_original, *img_buffer_original_end;
+
+   // set by the stbi_load_into family; decoders that can write their rows
+   // straight to out_dst do so and return it instead of allocating
+   stbi_uc *out_dst;
+   int out_stride, out_w, out_h;
 } stbi__context;
 
 
@@ -769,6 +904,7 @@ static void stbi__start_mem(stbi__context *s, stbi_uc const *buffer, int len)
 {
    s->io.read = NULL;
    s->read_from_callbacks = 0;
+   s->out_dst = NULL;
    s->img_buffer = s->img_buffer_original = (stbi_uc *) buffer;
    s->img_buffer_end = s->img_buffer_original_end = (stbi_uc *) buffer+len;
 }
@@ -780,6 +916,7 @@ static void stbi__start_callbacks(stbi__context *s, stbi_io_callbacks *c, void *
    s->io_user_data = user;
    s->buflen = sizeof(s->buffer_start);
    s->read_from_callbacks = 1;
+   s->out_dst = NULL;
    s->img_buffer_original = s->buffer_start;
    stbi__refill_buffer(s);
    s->img_buffer_original_end = s->img_buffer_end;
@@ -881,8 +1018,11 @@ static stbi_uc *stbi__pnm_load(stbi__context *s, int *x, int *y, int *comp, int
 static int      stbi__pnm_info(stbi__context *s, int *x, int *y, int *comp);
 #endif
 
-// this is not threadsafe
+#ifdef STBI_THREAD_LOCAL
+static STBI_THREAD_LOCAL const char *stbi__g_failure_reason;
+#else
 static const char *stbi__g_failure_reason;
+#endif
 
 STBIDEF const char *stbi_failure_reason(void)
 {
@@ -935,6 +1075,18 @@ STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip)
     stbi__vertically_flip_on_load = flag_true_if_should_flip;
 }
 
+// where decoded row y goes in the caller's buffer, flipped if requested
+static stbi_uc *stbi__out_row(stbi__context *s, stbi__uint32 y)
+{
+   if (stbi__vertically_flip_on_load) y = s->img_y - 1 - y;
+   return s->out_dst + (size_t) y * s->out_stride;
+}
+
+static int stbi__out_fits(stbi__context *s)
+{
+   return s->img_x <= (stbi__uint32) s->out_w && s->img_y <= (stbi__uint32) s->out_h;
+}
+
 static unsigned char *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int req_comp)
 {
    #ifndef STBI_NO_JPEG
@@ -1000,6 +1152,40 @@ static unsigned char *stbi__load_flip(stbi__context *s, int *x, int *y, int *com
    return result;
 }
 
+static int stbi__load_into(stbi__context *s, stbi_uc *dst, int dst_stride, int dst_w, int dst_h, int *x, int *y, int *comp, int req_comp)
+{
+   stbi_uc *result;
+   int w, h, row;
+
+   if (req_comp < 1 || req_comp > 4) return stbi__err("bad req_comp", "Internal error");
+   if (dst_w < 0 || dst_h < 0 || dst_stride < dst_w * req_comp) return stbi__err("bad stride", "Destination rows too short");
+
+   s->out_dst = dst;
+   s->out_stride = dst_stride;
+   s->out_w = dst_w;
+   s->out_h = dst_h;
+   result = stbi__load_main(s, &w, &h, comp, req_comp);
+   s->out_dst = NULL;
+   if (result == NULL) return 0;
+
+   if (result != dst) {
+      // the decoder allocated; copy its rows across
+      if (w > dst_w || h > dst_h) {
+         STBI_FREE(result);
+         return stbi__err("too large", "Image larger than destination");
+      }
+      for (row = 0; row < h; ++row) {
+         int from = stbi__vertically_flip_on_load ? h - 1 - row : row;
+         memcpy(dst + (size_t) row * dst_stride, result + (size_t) from * w * req_comp, (size_t) w * req_comp);
+      }
+      STBI_FREE(result);
+   }
+
+   *x = w;
+   *y = h;
+   return 1;
+}
+
 #ifndef STBI_NO_HDR
 static void stbi__float_postprocess(float *result, int *x, int *y, int *comp, int req_comp)
 {
@@ -1060,6 +1246,29 @@ STBIDEF stbi_uc *stbi_load_from_file(FILE *f, int *x, int *y, int *comp, int req
    }
    return result;
 }
+
+STBIDEF int stbi_load_into(char const *filename, stbi_uc *dst, int dst_stride, int dst_w, int dst_h, int *x, int *y, int *comp, int req_comp)
+{
+   FILE *f = stbi__fopen(filename, "rb");
+   int result;
+   if (!f) return stbi__err("can't fopen", "Unable to open file");
+   result = stbi_load_from_file_into(f,dst,dst_stride,dst_w,dst_h,x,y,comp,req_comp);
+   fclose(f);
+   return result;
+}
+
+STBIDEF int stbi_load_from_file_into(FILE *f, stbi_uc *dst, int dst_stride, int dst_w, int dst_h, int *x, int *y, int *comp, int req_comp)
+{
+   int result;
+   stbi__context s;
+   stbi__start_file(&s,f);
+   result = stbi__load_into(&s,dst,dst_stride,dst_w,dst_h,x,y,comp,req_comp);
+   if (result) {
+      // need to 'unget' all the characters in the IO buffer
+      fseek(f, - (int) (s.img_buffer_end - s.img_buffer), SEEK_CUR);
+   }
+   return result;
+}
 #endif //!STBI_NO_STDIO
 
 STBIDEF stbi_uc *stbi_load_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp)
@@ -1076,6 +1285,20 @@ STBIDEF stbi_uc *stbi_load_from_callbacks(stbi_io_callbacks const *clbk, void *u
    return stbi__load_flip(&s,x,y,comp,req_comp);
 }
 
+STBIDEF int stbi_load_from_memory_into(stbi_uc const *buffer, int len, stbi_uc *dst, int dst_stride, int dst_w, int dst_h, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   return stbi__load_into(&s,dst,dst_stride,dst_w,dst_h,x,y,comp,req_comp);
+}
+
+STBIDEF int stbi_load_from_callbacks_into(stbi_io_callbacks const *clbk, void *user, stbi_uc *dst, int dst_stride, int dst_w, int dst_h, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__context s;
+   stbi__start_callbacks(&s, (stbi_io_callbacks *) clbk, user);
+   return stbi__load_into(&s,dst,dst_stride,dst_w,dst_h,x,y,comp,req_comp);
+}
+
 #ifndef STBI_NO_LINEAR
 static float *stbi__loadf_main(stbi__context *s, int *x, int *y, int *comp, int req_comp)
 {
@@ -1516,6 +1739,11 @@ typedef struct
    void (*idct_block_kernel)(stbi_uc *out, int out_stride, short data[64]);
    void (*YCbCr_to_RGB_kernel)(stbi_uc *out, const stbi_uc *y, const stbi_uc *pcb, const stbi_uc *pcr, int count, int step);
    stbi_uc *(*resample_row_hv_2_kernel)(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs);
+   // optional two-block idct; while it's set, a block waits here for a partner
+   void (*idct_block2_kernel)(stbi_uc *out0, int out_stride0, short *data0, stbi_uc *out1, int out_stride1, short *data1);
+   stbi_uc *idct_pending_out;
+   int      idct_pending_stride;
+   short   *idct_pending_data;
 } stbi__jpeg;
 
 static int stbi__build_huffman(stbi__huffman *h, int *count)
@@ -2204,6 +2432,197 @@ static void stbi__idct_simd(stbi_uc *out, int out_stride, short data[64])
 #undef dct_pass
 }
 
+#ifdef STBI__X86_DISPATCH
+// the sse2 IDCT on two blocks at once, one in each 128-bit lane. avx2 only
+// widens the lanes, so every step, and the result, is the same.
+static STBI__TARGET_AVX2 void stbi__idct_simd2_avx2(stbi_uc *out0, int out_stride0, short *data0, stbi_uc *out1, int out_stride1, short *data1)
+{
+   __m256i row0, row1, row2, row3, row4, row5, row6, row7;
+   __m256i tmp;
+
+   // dot product constant: even elems=x, odd elems=y
+   #define dct_const(x,y)  _mm256_broadcastsi128_si256(_mm_setr_epi16((x),(y),(x),(y),(x),(y),(x),(y)))
+
+   // out(0) = c0[even]*x + c0[odd]*y   (c0, x, y 16-bit, out 32-bit)
+   // out(1) = c1[even]*x + c1[odd]*y
+   #define dct_rot(out0,out1, x,y,c0,c1) \
+      __m256i c0##lo = _mm256_unpacklo_epi16((x),(y)); \
+      __m256i c0##hi = _mm256_unpackhi_epi16((x),(y)); \
+      __m256i out0##_l = _mm256_madd_epi16(c0##lo, c0); \
+      __m256i out0##_h = _mm256_madd_epi16(c0##hi, c0); \
+      __m256i out1##_l = _mm256_madd_epi16(c0##lo, c1); \
+      __m256i out1##_h = _mm256_madd_epi16(c0##hi, c1)
+
+   // out = in << 12  (in 16-bit, out 32-bit)
+   #define dct_widen(out, in) \
+      __m256i out##_l = _mm256_srai_epi32(_mm256_unpacklo_epi16(_mm256_setzero_si256(), (in)), 4); \
+      __m256i out##_h = _mm256_srai_epi32(_mm256_unpackhi_epi16(_mm256_setzero_si256(), (in)), 4)
+
+   // wide add
+   #define dct_wadd(out, a, b) \
+      __m256i out##_l = _mm256_add_epi32(a##_l, b##_l); \
+      __m256i out##_h = _mm256_add_epi32(a##_h, b##_h)
+
+   // wide sub
+   #define dct_wsub(out, a, b) \
+      __m256i out##_l = _mm256_sub_epi32(a##_l, b##_l); \
+      __m256i out##_h = _mm256_sub_epi32(a##_h, b##_h)
+
+   // butterfly a/b, add bias, then shift by "s" and pack
+   #define dct_bfly32o(out0, out1, a,b,bias,s) \
+      { \
+         __m256i abiased_l = _mm256_add_epi32(a##_l, bias); \
+         __m256i abiased_h = _mm256_add_epi32(a##_h, bias); \
+         dct_wadd(sum, abiased, b); \
+         dct_wsub(dif, abiased, b); \
+         out0 = _mm256_packs_epi32(_mm256_srai_epi32(sum_l, s), _mm256_srai_epi32(sum_h, s)); \
+         out1 = _mm256_packs_epi32(_mm256_srai_epi32(dif_l, s), _mm256_srai_epi32(dif_h, s)); \
+      }
+
+   // 8-bit interleave step (for transposes)
+   #define dct_interleave8(a, b) \
+      tmp = a; \
+      a = _mm256_unpacklo_epi8(a, b); \
+      b = _mm256_unpackhi_epi8(tmp, b)
+
+   // 16-bit interleave step (for transposes)
+   #define dct_interleave16(a, b) \
+      tmp = a; \
+      a = _mm256_unpacklo_epi16(a, b); \
+      b = _mm256_unpackhi_epi16(tmp, b)
+
+   #define dct_pass(bias,shift) \
+      { \
+         /* even part */ \
+         dct_rot(t2e,t3e, row2,row6, rot0_0,rot0_1); \
+         __m256i sum04 = _mm256_add_epi16(row0, row4); \
+         __m256i dif04 = _mm256_sub_epi16(row0, row4); \
+         dct_widen(t0e, sum04); \
+         dct_widen(t1e, dif04); \
+         dct_wadd(x0, t0e, t3e); \
+         dct_wsub(x3, t0e, t3e); \
+         dct_wadd(x1, t1e, t2e); \
+         dct_wsub(x2, t1e, t2e); \
+         /* odd part */ \
+         dct_rot(y0o,y2o, row7,row3, rot2_0,rot2_1); \
+         dct_rot(y1o,y3o, row5,row1, rot3_0,rot3_1); \
+         __m256i sum17 = _mm256_add_epi16(row1, row7); \
+         __m256i sum35 = _mm256_add_epi16(row3, row5); \
+         dct_rot(y4o,y5o, sum17,sum35, rot1_0,rot1_1); \
+         dct_wadd(x4, y0o, y4o); \
+         dct_wadd(x5, y1o, y5o); \
+         dct_wadd(x6, y2o, y5o); \
+         dct_wadd(x7, y3o, y4o); \
+         dct_bfly32o(row0,row7, x0,x7,bias,shift); \
+         dct_bfly32o(row1,row6, x1,x6,bias,shift); \
+         dct_bfly32o(row2,row5, x2,x5,bias,shift); \
+         dct_bfly32o(row3,row4, x3,x4,bias,shift); \
+      }
+
+   // row k of the first block in the low lane, of the second in the high
+   #define dct_load(k) \
+      _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_load_si128((const __m128i *) (data0 + (k)*8))), \
+                              _mm_load_si128((const __m128i *) (data1 + (k)*8)), 1)
+
+   // two rows of each block, as in the sse2 version
+   #define dct_store2(p) \
+      { \
+         __m128i lo = _mm256_castsi256_si128(p), hi = _mm256_extracti128_si256(p, 1); \
+         _mm_storel_epi64((__m128i *) out0, lo); out0 += out_stride0; \
+         _mm_storel_epi64((__m128i *) out0, _mm_shuffle_epi32(lo, 0x4e)); out0 += out_stride0; \
+         _mm_storel_epi64((__m128i *) out1, hi); out1 += out_stride1; \
+         _mm_storel_epi64((__m128i *) out1, _mm_shuffle_epi32(hi, 0x4e)); out1 += out_stride1; \
+      }
+
+   __m256i rot0_0 = dct_const(stbi__f2f(0.5411961f), stbi__f2f(0.5411961f) + stbi__f2f(-1.847759065f));
+   __m256i rot0_1 = dct_const(stbi__f2f(0.5411961f) + stbi__f2f( 0.765366865f), stbi__f2f(0.5411961f));
+   __m256i rot1_0 = dct_const(stbi__f2f(1.175875602f) + stbi__f2f(-0.899976223f), stbi__f2f(1.175875602f));
+   __m256i rot1_1 = dct_const(stbi__f2f(1.175875602f), stbi__f2f(1.175875602f) + stbi__f2f(-2.562915447f));
+   __m256i rot2_0 = dct_const(stbi__f2f(-1.961570560f) + stbi__f2f( 0.298631336f), stbi__f2f(-1.961570560f));
+   __m256i rot2_1 = dct_const(stbi__f2f(-1.961570560f), stbi__f2f(-1.961570560f) + stbi__f2f( 3.072711026f));
+   __m256i rot3_0 = dct_const(stbi__f2f(-0.390180644f) + stbi__f2f( 2.053119869f), stbi__f2f(-0.390180644f));
+   __m256i rot3_1 = dct_const(stbi__f2f(-0.390180644f), stbi__f2f(-0.390180644f) + stbi__f2f( 1.501321110f));
+
+   // rounding biases in column/row passes, see stbi__idct_block for explanation.
+   __m256i bias_0 = _mm256_set1_epi32(512);
+   __m256i bias_1 = _mm256_set1_epi32(65536 + (128<<17));
+
+   // load
+   row0 = dct_load(0);
+   row1 = dct_load(1);
+   row2 = dct_load(2);
+   row3 = dct_load(3);
+   row4 = dct_load(4);
+   row5 = dct_load(5);
+   row6 = dct_load(6);
+   row7 = dct_load(7);
+
+   // column pass
+   dct_pass(bias_0, 10);
+
+   {
+      // 16bit 8x8 transpose pass 1
+      dct_interleave16(row0, row4);
+      dct_interleave16(row1, row5);
+      dct_interleave16(row2, row6);
+      dct_interleave16(row3, row7);
+
+      // transpose pass 2
+      dct_interleave16(row0, row2);
+      dct_interleave16(row1, row3);
+      dct_interleave16(row4, row6);
+      dct_interleave16(row5, row7);
+
+      // transpose pass 3
+      dct_interleave16(row0, row1);
+      dct_interleave16(row2, row3);
+      dct_interleave16(row4, row5);
+      dct_interleave16(row6, row7);
+   }
+
+   // row pass
+   dct_pass(bias_1, 17);
+
+   {
+      // pack
+      __m256i p0 = _mm256_packus_epi16(row0, row1);
+      __m256i p1 = _mm256_packus_epi16(row2, row3);
+      __m256i p2 = _mm256_packus_epi16(row4, row5);
+      __m256i p3 = _mm256_packus_epi16(row6, row7);
+
+      // 8bit 8x8 transpose pass 1
+      dct_interleave8(p0, p2);
+      dct_interleave8(p1, p3);
+
+      // transpose pass 2
+      dct_interleave8(p0, p1);
+      dct_interleave8(p2, p3);
+
+      // transpose pass 3
+      dct_interleave8(p0, p2);
+      dct_interleave8(p1, p3);
+
+      // store
+      dct_store2(p0);
+      dct_store2(p2);
+      dct_store2(p1);
+      dct_store2(p3);
+   }
+
+#undef dct_const
+#undef dct_rot
+#undef dct_widen
+#undef dct_wadd
+#undef dct_wsub
+#undef dct_bfly32o
+#undef dct_interleave8
+#undef dct_interleave16
+#undef dct_pass
+#undef dct_load
+#undef dct_store2
+}
+#endif // STBI__X86_DISPATCH
+
 #endif // STBI_SSE2
 
 #ifdef STBI_NEON
@@ -2448,13 +2867,39 @@ static void stbi__jpeg_reset(stbi__jpeg *j)
    // since we don't even allow 1<<30 pixels
 }
 
+// run the idct on a block, or hold it until a second one arrives if the
+// kernel does two at once. data must stay untouched until the pair has run
+static void stbi__jpeg_idct(stbi__jpeg *z, stbi_uc *out, int out_stride, short *data)
+{
+   if (!z->idct_block2_kernel) {
+      z->idct_block_kernel(out, out_stride, data);
+   } else if (!z->idct_pending_data) {
+      z->idct_pending_out = out;
+      z->idct_pending_stride = out_stride;
+      z->idct_pending_data = data;
+   } else {
+      z->idct_block2_kernel(z->idct_pending_out, z->idct_pending_stride, z->idct_pending_data, out, out_stride, data);
+      z->idct_pending_data = NULL;
+   }
+}
+
+static void stbi__jpeg_idct_flush(stbi__jpeg *z)
+{
+   if (z->idct_pending_data) {
+      z->idct_block_kernel(z->idct_pending_out, z->idct_pending_stride, z->idct_pending_data);
+      z->idct_pending_data = NULL;
+   }
+}
+
 static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
 {
    stbi__jpeg_reset(z);
+   z->idct_pending_data = NULL;
    if (!z->progressive) {
       if (z->scan_n == 1) {
          int i,j;
-         STBI_SIMD_ALIGN(short, data[64]);
+         // two blocks, so one can wait for the paired idct while the next decodes
+         STBI_SIMD_ALIGN(short, data[128]);
          int n = z->order[0];
          // non-interleaved data, we just need to process one block at a time,
          // in trivial scanline order
@@ -2465,22 +2910,24 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
          for (j=0; j < h; ++j) {
             for (i=0; i < w; ++i) {
                int ha = z->img_comp[n].ha;
-               if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
+               short *block = z->idct_pending_data == data ? data + 64 : data;
+               if (!stbi__jpeg_decode_block(z, block, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+               stbi__jpeg_idct(z, z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, block);
                // every data block is an MCU, so countdown the restart interval
                if (--z->todo <= 0) {
                   if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
                   // if it's NOT a restart, then just bail, so we get corrupt data
                   // rather than no data
-                  if (!STBI__RESTART(z->marker)) return 1;
+                  if (!STBI__RESTART(z->marker)) { stbi__jpeg_idct_flush(z); return 1; }
                   stbi__jpeg_reset(z);
                }
             }
          }
+         stbi__jpeg_idct_flush(z);
          return 1;
       } else { // interleaved
          int i,j,k,x,y;
-         STBI_SIMD_ALIGN(short, data[64]);
+         STBI_SIMD_ALIGN(short, data[128]);
          for (j=0; j < z->img_mcu_y; ++j) {
             for (i=0; i < z->img_mcu_x; ++i) {
                // scan an interleaved mcu... process scan_n components in order
@@ -2493,8 +2940,9 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
                         int x2 = (i*z->img_comp[n].h + x)*8;
                         int y2 = (j*z->img_comp[n].v + y)*8;
                         int ha = z->img_comp[n].ha;
-                        if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-                        z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data);
+                        short *block = z->idct_pending_data == data ? data + 64 : data;
+                        if (!stbi__jpeg_decode_block(z, block, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+                        stbi__jpeg_idct(z, z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, block);
                      }
                   }
                }
@@ -2502,11 +2950,12 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
                // so now count down the restart interval
                if (--z->todo <= 0) {
                   if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
-                  if (!STBI__RESTART(z->marker)) return 1;
+                  if (!STBI__RESTART(z->marker)) { stbi__jpeg_idct_flush(z); return 1; }
                   stbi__jpeg_reset(z);
                }
             }
          }
+         stbi__jpeg_idct_flush(z);
          return 1;
       }
    } else {
@@ -2584,6 +3033,7 @@ static void stbi__jpeg_finish(stbi__jpeg *z)
    if (z->progressive) {
       // dequantize and idct the data
       int i,j,n;
+      z->idct_pending_data = NULL;
       for (n=0; n < z->s->img_n; ++n) {
          int w = (z->img_comp[n].x+7) >> 3;
          int h = (z->img_comp[n].y+7) >> 3;
@@ -2591,10 +3041,11 @@ static void stbi__jpeg_finish(stbi__jpeg *z)
             for (i=0; i < w; ++i) {
                short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
                stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
+               stbi__jpeg_idct(z, z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
             }
          }
       }
+      stbi__jpeg_idct_flush(z);
    }
 }
 
@@ -3055,6 +3506,72 @@ static stbi_uc *stbi__resample_row_hv_2_simd(stbi_uc *out, stbi_uc *in_near, stb
 }
 #endif
 
+#if defined(STBI_SSE2) && defined(STBI__X86_DISPATCH)
+// the sse2 version above, 16 pixels at a time
+static STBI__TARGET_AVX2 stbi_uc *stbi__resample_row_hv_2_avx2(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
+{
+   int i=0,t0,t1;
+
+   if (w == 1) {
+      out[0] = out[1] = stbi__div4(3*in_near[0] + in_far[0] + 2);
+      return out;
+   }
+
+   t1 = 3*in_near[0] + in_far[0];
+   for (; i < ((w-1) & ~15); i += 16) {
+      // vertical pass, 3*x + y = 4*x + (y - x)
+      __m256i farw  = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_far + i)));
+      __m256i nearw = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_near + i)));
+      __m256i diff  = _mm256_sub_epi16(farw, nearw);
+      __m256i nears = _mm256_slli_epi16(nearw, 2);
+      __m256i curr  = _mm256_add_epi16(nears, diff); // current row
+
+      // byte shifts stay within a lane, so carry the pixel across the middle
+      // by aligning against the other half of curr
+      __m256i prv0 = _mm256_alignr_epi8(curr, _mm256_permute2x128_si256(curr, curr, 0x08), 14);
+      __m256i nxt0 = _mm256_alignr_epi8(_mm256_permute2x128_si256(curr, curr, 0x81), curr, 2);
+      __m256i prev = _mm256_insert_epi16(prv0, t1, 0);
+      __m256i next = _mm256_insert_epi16(nxt0, 3*in_near[i+16] + in_far[i+16], 15);
+
+      // horizontal pass
+      __m256i bias = _mm256_set1_epi16(8);
+      __m256i curs = _mm256_slli_epi16(curr, 2);
+      __m256i prvd = _mm256_sub_epi16(prev, curr);
+      __m256i nxtd = _mm256_sub_epi16(next, curr);
+      __m256i curb = _mm256_add_epi16(curs, bias);
+      __m256i even = _mm256_add_epi16(prvd, curb);
+      __m256i odd  = _mm256_add_epi16(nxtd, curb);
+
+      // interleave, undo scaling and pack; each lane holds eight whole
+      // pixels, so the output comes out in order
+      __m256i int0 = _mm256_unpacklo_epi16(even, odd);
+      __m256i int1 = _mm256_unpackhi_epi16(even, odd);
+      __m256i de0  = _mm256_srli_epi16(int0, 4);
+      __m256i de1  = _mm256_srli_epi16(int1, 4);
+      _mm256_storeu_si256((__m256i *) (out + i*2), _mm256_packus_epi16(de0, de1));
+
+      // "previous" value for next iter
+      t1 = 3*in_near[i+15] + in_far[i+15];
+   }
+
+   t0 = t1;
+   t1 = 3*in_near[i] + in_far[i];
+   out[i*2] = stbi__div16(3*t1 + t0 + 8);
+
+   for (++i; i < w; ++i) {
+      t0 = t1;
+      t1 = 3*in_near[i]+in_far[i];
+      out[i*2-1] = stbi__div16(3*t0 + t1 + 8);
+      out[i*2  ] = stbi__div16(3*t1 + t0 + 8);
+   }
+   out[w*2-1] = stbi__div4(t1+2);
+
+   STBI_NOTUSED(hs);
+
+   return out;
+}
+#endif
+
 static stbi_uc *stbi__resample_row_generic(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
 {
    // resample with nearest-neighbor
@@ -3259,21 +3776,95 @@ static void stbi__YCbCr_to_RGB_simd(stbi_uc *out, stbi_uc const *y, stbi_uc cons
 }
 #endif
 
+#if defined(STBI_SSE2) && defined(STBI__X86_DISPATCH) && !defined(STBI_JPEG_OLD)
+// the sse2 step == 4 loop on 16 pixels at a time; it finishes the row, and
+// handles other steps, so the output matches it exactly
+static STBI__TARGET_AVX2 void stbi__YCbCr_to_RGB_avx2(stbi_uc *out, stbi_uc const *y, stbi_uc const *pcb, stbi_uc const *pcr, int count, int step)
+{
+   int i = 0;
+
+   if (step == 4) {
+      __m128i signflip  = _mm_set1_epi8(-0x80);
+      __m256i cr_const0 = _mm256_set1_epi16(   (short) ( 1.40200f*4096.0f+0.5f));
+      __m256i cr_const1 = _mm256_set1_epi16( - (short) ( 0.71414f*4096.0f+0.5f));
+      __m256i cb_const0 = _mm256_set1_epi16( - (short) ( 0.34414f*4096.0f+0.5f));
+      __m256i cb_const1 = _mm256_set1_epi16(   (short) ( 1.77200f*4096.0f+0.5f));
+      __m256i y_bias = _mm256_set1_epi16(8);
+      __m256i xw = _mm256_set1_epi16(255); // alpha channel
+
+      for (; i+15 < count; i += 16) {
+         // load, and widen to the same words the sse2 unpacks produce:
+         // y<<4 plus rounding, cr and cb in the high byte
+         __m128i y_bytes  = _mm_loadu_si128((__m128i *) (y+i));
+         __m128i cr_bytes = _mm_loadu_si128((__m128i *) (pcr+i));
+         __m128i cb_bytes = _mm_loadu_si128((__m128i *) (pcb+i));
+         __m256i yws = _mm256_add_epi16(_mm256_slli_epi16(_mm256_cvtepu8_epi16(y_bytes), 4), y_bias);
+         __m256i crw = _mm256_slli_epi16(_mm256_cvtepi8_epi16(_mm_xor_si128(cr_bytes, signflip)), 8);
+         __m256i cbw = _mm256_slli_epi16(_mm256_cvtepi8_epi16(_mm_xor_si128(cb_bytes, signflip)), 8);
+
+         // color transform
+         __m256i cr0 = _mm256_mulhi_epi16(cr_const0, crw);
+         __m256i cb0 = _mm256_mulhi_epi16(cb_const0, cbw);
+         __m256i cb1 = _mm256_mulhi_epi16(cbw, cb_const1);
+         __m256i cr1 = _mm256_mulhi_epi16(crw, cr_const1);
+         __m256i rws = _mm256_add_epi16(cr0, yws);
+         __m256i gwt = _mm256_add_epi16(cb0, yws);
+         __m256i bws = _mm256_add_epi16(yws, cb1);
+         __m256i gws = _mm256_add_epi16(gwt, cr1);
+
+         // descale
+         __m256i rw = _mm256_srai_epi16(rws, 4);
+         __m256i bw = _mm256_srai_epi16(bws, 4);
+         __m256i gw = _mm256_srai_epi16(gws, 4);
+
+         // back to byte, set up for transpose
+         __m256i brb = _mm256_packus_epi16(rw, bw);
+         __m256i gxb = _mm256_packus_epi16(gw, xw);
+
+         // transpose to interleave channels; o0 holds pixels 0-3 and 8-11,
+         // o1 pixels 4-7 and 12-15
+         __m256i t0 = _mm256_unpacklo_epi8(brb, gxb);
+         __m256i t1 = _mm256_unpackhi_epi8(brb, gxb);
+         __m256i o0 = _mm256_unpacklo_epi16(t0, t1);
+         __m256i o1 = _mm256_unpackhi_epi16(t0, t1);
+
+         // store
+         _mm256_storeu_si256((__m256i *) (out + 0), _mm256_permute2x128_si256(o0, o1, 0x20));
+         _mm256_storeu_si256((__m256i *) (out + 32), _mm256_permute2x128_si256(o0, o1, 0x31));
+         out += 64;
+      }
+   }
+
+   stbi__YCbCr_to_RGB_simd(out, y+i, pcb+i, pcr+i, count-i, step);
+}
+#endif
+
 // set up the kernels
 static void stbi__setup_jpeg(stbi__jpeg *j)
 {
    j->idct_block_kernel = stbi__idct_block;
    j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_row;
    j->resample_row_hv_2_kernel = stbi__resample_row_hv_2;
+   j->idct_block2_kernel = NULL;
 
 #ifdef STBI_SSE2
-   if (stbi__sse2_available()) {
+   if (stbi_get_simd_level() >= STBI_SIMD_SSE2) {
       j->idct_block_kernel = stbi__idct_simd;
       #ifndef STBI_JPEG_OLD
       j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_simd;
       #endif
       j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_simd;
    }
+   #ifdef STBI__X86_DISPATCH
+   // the sse2 kernels still handle lone blocks and the ends of rows
+   if (stbi_get_simd_level() >= STBI_SIMD_AVX2) {
+      j->idct_block2_kernel = stbi__idct_simd2_avx2;
+      #ifndef STBI_JPEG_OLD
+      j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_avx2;
+      #endif
+      j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_avx2;
+   }
+   #endif
 #endif
 
 #ifdef STBI_NEON
@@ -3338,7 +3929,7 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
 
    // resample and color-convert
    {
-      int k;
+      int k, direct;
       unsigned int i,j;
       stbi_uc *output;
       stbi_uc *coutput[4];
@@ -3367,13 +3958,22 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
          else                               r->resample = stbi__resample_row_generic;
       }
 
+      // 3-channel rows write a byte past their last pixel, so only
+      // other layouts go straight to the caller's buffer
+      direct = z->s->out_dst != NULL && n != 3;
+
       // can't error after this so, this is safe
-      output = (stbi_uc *) stbi__malloc(n * z->s->img_x * z->s->img_y + 1);
-      if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
+      if (direct) {
+         if (!stbi__out_fits(z->s)) { stbi__cleanup_jpeg(z); return stbi__errpuc("too large", "Image larger than destination"); }
+         output = z->s->out_dst;
+      } else {
+         output = (stbi_uc *) stbi__malloc(n * z->s->img_x * z->s->img_y + 1);
+         if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
+      }
 
       // now go ahead and resample
       for (j=0; j < z->s->img_y; ++j) {
-         stbi_uc *out = output + n * z->s->img_x * j;
+         stbi_uc *out = direct ? stbi__out_row(z->s, j) : output + n * z->s->img_x * j;
          for (k=0; k < decode_n; ++k) {
             stbi__resample *r = &res_comp[k];
             int y_bot = r->ystep >= (r->vs >> 1);
@@ -3479,9 +4079,32 @@ static int stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp)
 #ifndef STBI_NO_ZLIB
 
 // fast-way is faster to check than jpeg huffman, but slow way is slower
-#define STBI__ZFAST_BITS  9 // accelerate all cases in default tables
+#define STBI__ZFAST_BITS  11 // accelerate all cases in default tables, and most in dynamic ones
 #define STBI__ZFAST_MASK  ((1 << STBI__ZFAST_BITS) - 1)
 
+// output room the fast inflate loop needs: the longest match, plus the
+// bytes its word-at-a-time copy can write past the end
+#define STBI__ZFAST_OUT   (258 + 8)
+
+// set by stbi_zlib_set_fast_inflate() before any thread starts decoding
+static int stbi__zfast_inflate = 1;
+
+STBIDEF void stbi_zlib_set_fast_inflate(int flag_true_if_fast)
+{
+   stbi__zfast_inflate = flag_true_if_fast;
+}
+
+#ifdef STBI_THREAD_LOCAL
+static STBI_THREAD_LOCAL stbi_zlib_stats stbi__zstats;
+#else
+static stbi_zlib_stats stbi__zstats;
+#endif
+
+STBIDEF stbi_zlib_stats stbi_zlib_get_stats(void)
+{
+   return stbi__zstats;
+}
+
 // zlib-style huffman encoding
 // (jpegs packs from left, zlib from right, so can't share code)
 typedef struct
@@ -3568,7 +4191,8 @@ typedef struct
 {
    stbi_uc *zbuffer, *zbuffer_end;
    int num_bits;
-   stbi__uint32 code_buffer;
+   int num_padding; // zero bytes fed in past zbuffer_end
+   stbi__uint64 code_buffer; // bits above num_bits may hold input not yet counted
 
    char *zout;
    char *zout_start;
@@ -3576,6 +4200,14 @@ typedef struct
    int   z_expandable;
 
    stbi__zhuffman z_length, z_distance;
+
+   // z_length's fast table with up to two literals per entry:
+   //    bits  0-4   bits the entry consumes
+   //    bits  5-6   number of literals, 0 for a length or end of block
+   //    bit   7     set for a length or end of block
+   //    bits  8-16  first literal or symbol; bits 16-23 second literal
+   // 0 means the code is longer than STBI__ZFAST_BITS
+   stbi__uint32 z_fast_literals[1 << STBI__ZFAST_BITS];
 } stbi__zbuf;
 
 stbi_inline static stbi_uc stbi__zget8(stbi__zbuf *z)
@@ -3586,11 +4218,25 @@ stbi_inline static stbi_uc stbi__zget8(stbi__zbuf *z)
 
 static void stbi__fill_bits(stbi__zbuf *z)
 {
-   do {
-      STBI_ASSERT(z->code_buffer < (1U << z->num_bits));
-      z->code_buffer |= (unsigned int) stbi__zget8(z) << z->num_bits;
+   while (z->num_bits <= 56) {
+      if (z->zbuffer >= z->zbuffer_end) ++z->num_padding;
+      z->code_buffer |= (stbi__uint64) stbi__zget8(z) << z->num_bits;
       z->num_bits += 8;
-   } while (z->num_bits <= 24);
+   }
+}
+
+stbi_inline static stbi__uint64 stbi__zload64(const stbi_uc *p)
+{
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+   stbi__uint64 v;
+   memcpy(&v, p, 8); // little-endian
+   return v;
+#else
+   return  (stbi__uint64) p[0]        | ((stbi__uint64) p[1] <<  8) |
+          ((stbi__uint64) p[2] << 16) | ((stbi__uint64) p[3] << 24) |
+          ((stbi__uint64) p[4] << 32) | ((stbi__uint64) p[5] << 40) |
+          ((stbi__uint64) p[6] << 48) | ((stbi__uint64) p[7] << 56);
+#endif
 }
 
 stbi_inline static unsigned int stbi__zreceive(stbi__zbuf *z, int n)
@@ -3608,7 +4254,7 @@ static int stbi__zhuffman_decode_slowpath(stbi__zbuf *a, stbi__zhuffman *z)
    int b,s,k;
    // not resolved by fast table, so compute it the slow way
    // use jpeg approach, which requires MSbits at top
-   k = stbi__bit_reverse(a->code_buffer, 16);
+   k = stbi__bit_reverse((int) (a->code_buffer & 0xffff), 16);
    for (s=STBI__ZFAST_BITS+1; ; ++s)
       if (k < z->maxcode[s])
          break;
@@ -3625,7 +4271,7 @@ stbi_inline static int stbi__zhuffman_decode(stbi__zbuf *a, stbi__zhuffman *z)
 {
    int b,s;
    if (a->num_bits < 16) stbi__fill_bits(a);
-   b = z->fast[a->code_buffer & STBI__ZFAST_MASK];
+   b = z->fast[(int) (a->code_buffer & STBI__ZFAST_MASK)];
    if (b) {
       s = b >> 9;
       a->code_buffer >>= s;
@@ -3648,6 +4294,8 @@ static int stbi__zexpand(stbi__zbuf *z, char *zout, int n)  // need to make room
    q = (char *) STBI_REALLOC_SIZED(z->zout_start, old_limit, limit);
    STBI_NOTUSED(old_limit);
    if (q == NULL) return stbi__err("outofmem", "Out of memory");
+   ++stbi__zstats.allocations;
+   stbi__zstats.bytes_copied += cur;
    z->zout_start = q;
    z->zout       = q + cur;
    z->zout_end   = q + limit;
@@ -3668,11 +4316,167 @@ static int stbi__zdist_base[32] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,
 static int stbi__zdist_extra[32] =
 { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13};
 
+static void stbi__zbuild_fast_literals(stbi__zbuf *a)
+{
+   stbi__uint16 *fast = a->z_length.fast;
+   int i;
+   for (i=0; i < (1 << STBI__ZFAST_BITS); ++i) {
+      int b = fast[i], s = b >> 9, v = b & 511;
+      stbi__uint32 e = 0;
+      if (b && v >= 256) {
+         e = (1 << 7) | (v << 8) | s;
+      } else if (b) {
+         // the bits left after the first code pick the second, if they
+         // hold all of it
+         int b2 = fast[i >> s], s2 = b2 >> 9, v2 = b2 & 511;
+         if (b2 && v2 < 256 && s + s2 <= STBI__ZFAST_BITS)
+            e = (2 << 5) | (v2 << 16) | (v << 8) | (s + s2);
+         else
+            e = (1 << 5) | (v << 8) | s;
+      }
+      a->z_fast_literals[i] = e;
+   }
+}
+
+// copies a match a word at a time; needs dist bytes of output behind zout
+// and room for 16 bytes, or len+7, after it
+stbi_inline static void stbi__zcopy_match(char *zout, int dist, int len)
+{
+   char *end = zout + len;
+   char *p = zout - dist;
+   if (dist == 1) { // run of one byte; common in images.
+      memset(zout, *p, len);
+      return;
+   }
+   if (dist < 8) {
+      // the output repeats every dist bytes, so once a multiple of dist
+      // that's at least 8 bytes is behind us, words can be copied from there
+      int period = dist * ((8 + dist - 1) / dist);
+      int n = period - dist;
+      if (len <= n) {
+         while (zout < end) *zout++ = *p++;
+         return;
+      }
+      while (n-- > 0) *zout++ = *p++;
+      p = zout - period;
+   }
+   // most matches are short, so start with two words unconditionally
+   memcpy(zout, p, 8);
+   memcpy(zout + 8, p + 8, 8);
+   zout += 16;
+   p += 16;
+   while (zout < end) {
+      memcpy(zout, p, 8);
+      zout += 8;
+      p += 8;
+   }
+}
+
+// decodes while there are at least 8 bytes of input and STBI__ZFAST_OUT
+// bytes of output room left, keeping the bit buffer in locals: a is only
+// read and written at the ends, since every store through zout may alias it.
+// returns 1 at the end of the block, 2 when the careful loop has to take
+// over, 0 on error
+static int stbi__zinflate_fast(stbi__zbuf *a, char **pzout)
+{
+   stbi__uint64 code_buffer = a->code_buffer;
+   int num_bits = a->num_bits;
+   stbi_uc *zbuffer = a->zbuffer, *zbuffer_end = a->zbuffer_end;
+   char *zout = *pzout, *zout_start = a->zout_start, *zout_end = a->zout_end;
+   int result = 2;
+
+   while (zout_end - zout >= STBI__ZFAST_OUT) {
+      stbi__uint32 e;
+      int z,len,dist;
+      // 48 bits cover a whole iteration: at most 15+5 bits of length and
+      // 15+13 of distance. a refill leaves at least 56, so literals usually
+      // get a few lookups out of one. it ors in 8 bytes but only counts the
+      // whole bytes that fit; the next refill ors the rest in again unchanged
+      if (num_bits < 48) {
+         if (zbuffer_end - zbuffer < 8) break;
+         code_buffer |= stbi__zload64(zbuffer) << num_bits;
+         zbuffer += (63 - num_bits) >> 3;
+         num_bits |= 56;
+      }
+      e = a->z_fast_literals[(int) (code_buffer & STBI__ZFAST_MASK)];
+      if (e & (3 << 5)) {
+         code_buffer >>= e & 31;
+         num_bits -= e & 31;
+         // the second byte is junk for a single literal, but there's room
+         zout[0] = (char) (e >> 8);
+         zout[1] = (char) (e >> 16);
+         zout += (e >> 5) & 3;
+         continue;
+      }
+      if (e) {
+         code_buffer >>= e & 31;
+         num_bits -= e & 31;
+         z = (e >> 8) & 511;
+      } else {
+         a->code_buffer = code_buffer;
+         a->num_bits = num_bits;
+         z = stbi__zhuffman_decode_slowpath(a, &a->z_length);
+         code_buffer = a->code_buffer;
+         num_bits = a->num_bits;
+         if (z < 0) { result = stbi__err("bad huffman code","Corrupt PNG"); break; }
+         if (z < 256) {
+            *zout++ = (char) z;
+            continue;
+         }
+      }
+      if (z == 256) {
+         result = 1;
+         break;
+      }
+      z -= 257;
+      len = stbi__zlength_base[z] + (int) (code_buffer & ((1 << stbi__zlength_extra[z]) - 1));
+      code_buffer >>= stbi__zlength_extra[z];
+      num_bits -= stbi__zlength_extra[z];
+
+      z = a->z_distance.fast[(int) (code_buffer & STBI__ZFAST_MASK)];
+      if (z) {
+         code_buffer >>= z >> 9;
+         num_bits -= z >> 9;
+         z &= 511;
+      } else {
+         a->code_buffer = code_buffer;
+         a->num_bits = num_bits;
+         z = stbi__zhuffman_decode_slowpath(a, &a->z_distance);
+         code_buffer = a->code_buffer;
+         num_bits = a->num_bits;
+      }
+      if (z < 0 || z >= 30) { result = stbi__err("bad huffman code","Corrupt PNG"); break; }
+      dist = stbi__zdist_base[z] + (int) (code_buffer & ((1 << stbi__zdist_extra[z]) - 1));
+      code_buffer >>= stbi__zdist_extra[z];
+      num_bits -= stbi__zdist_extra[z];
+      if (zout - zout_start < dist) { result = stbi__err("bad dist","Corrupt PNG"); break; }
+      stbi__zcopy_match(zout, dist, len);
+      zout += len;
+   }
+
+   a->code_buffer = code_buffer;
+   a->num_bits = num_bits;
+   a->zbuffer = zbuffer;
+   *pzout = zout;
+   return result;
+}
+
 static int stbi__parse_huffman_block(stbi__zbuf *a)
 {
    char *zout = a->zout;
    for(;;) {
-      int z = stbi__zhuffman_decode(a, &a->z_length);
+      int z,len,dist;
+      if (stbi__zfast_inflate && a->zout_end - zout >= STBI__ZFAST_OUT && a->zbuffer_end - a->zbuffer >= 8) {
+         z = stbi__zinflate_fast(a, &zout);
+         if (z != 2) {
+            a->zout = zout;
+            return z;
+         }
+      }
+
+      // near the end of the output buffer, or with the fast loop off, go
+      // one symbol at a time with bounds checks
+      z = stbi__zhuffman_decode(a, &a->z_length);
       if (z < 256) {
          if (z < 0) return stbi__err("bad huffman code","Corrupt PNG"); // error in huffman codes
          if (zout >= a->zout_end) {
@@ -3682,7 +4486,6 @@ static int stbi__parse_huffman_block(stbi__zbuf *a)
          *zout++ = (char) z;
       } else {
          stbi_uc *p;
-         int len,dist;
          if (z == 256) {
             a->zout = zout;
             return 1;
@@ -3691,7 +4494,7 @@ static int stbi__parse_huffman_block(stbi__zbuf *a)
          len = stbi__zlength_base[z];
          if (stbi__zlength_extra[z]) len += stbi__zreceive(a, stbi__zlength_extra[z]);
          z = stbi__zhuffman_decode(a, &a->z_distance);
-         if (z < 0) return stbi__err("bad huffman code","Corrupt PNG");
+         if (z < 0 || z >= 30) return stbi__err("bad huffman code","Corrupt PNG");
          dist = stbi__zdist_base[z];
          if (stbi__zdist_extra[z]) dist += stbi__zreceive(a, stbi__zdist_extra[z]);
          if (zout - a->zout_start < dist) return stbi__err("bad dist","Corrupt PNG");
@@ -3736,6 +4539,7 @@ static int stbi__compute_huffman_codes(stbi__zbuf *a)
       if (c < 16)
          lencodes[n++] = (stbi_uc) c;
       else if (c == 16) {
+         if (n == 0) return stbi__err("bad codelengths","Corrupt PNG"); // nothing to repeat
          c = stbi__zreceive(a,2)+3;
          memset(lencodes+n, lencodes[n-1], c);
          n += c;
@@ -3762,17 +4566,15 @@ static int stbi__parse_uncompressed_block(stbi__zbuf *a)
    int len,nlen,k;
    if (a->num_bits & 7)
       stbi__zreceive(a, a->num_bits & 7); // discard
-   // drain the bit-packed data into header
-   k = 0;
-   while (a->num_bits > 0) {
-      header[k++] = (stbi_uc) (a->code_buffer & 255); // suppress MSVC run-time check
-      a->code_buffer >>= 8;
-      a->num_bits -= 8;
-   }
-   STBI_ASSERT(a->num_bits == 0);
-   // now fill header the normal way
-   while (k < 4)
-      header[k++] = stbi__zget8(a);
+   // hand the whole bytes left in the bit buffer back to the input, except
+   // any zero padding from past its end
+   k = (a->num_bits >> 3) - a->num_padding;
+   if (k > 0) a->zbuffer -= k;
+   a->code_buffer = 0;
+   a->num_bits = 0;
+   a->num_padding = 0;
+   for (k=0; k < 4; ++k)
+      header[k] = stbi__zget8(a);
    len  = header[1] * 256 + header[0];
    nlen = header[3] * 256 + header[2];
    if (nlen != (len ^ 0xffff)) return stbi__err("zlib corrupt","Corrupt PNG");
@@ -3817,6 +4619,7 @@ static int stbi__parse_zlib(stbi__zbuf *a, int parse_header)
    if (parse_header)
       if (!stbi__parse_zlib_header(a)) return 0;
    a->num_bits = 0;
+   a->num_padding = 0;
    a->code_buffer = 0;
    do {
       final = stbi__zreceive(a,1);
@@ -3834,6 +4637,7 @@ static int stbi__parse_zlib(stbi__zbuf *a, int parse_header)
          } else {
             if (!stbi__compute_huffman_codes(a)) return 0;
          }
+         stbi__zbuild_fast_literals(a);
          if (!stbi__parse_huffman_block(a)) return 0;
       }
    } while (!final);
@@ -3847,6 +4651,10 @@ static int stbi__do_zlib(stbi__zbuf *a, char *obuf, int olen, int exp, int parse
    a->zout_end   = obuf + olen;
    a->z_expandable = exp;
 
+   // only the malloc'ing entry points pass an expandable buffer
+   stbi__zstats.allocations = exp ? 1 : 0;
+   stbi__zstats.bytes_copied = 0;
+
    return stbi__parse_zlib(a, parse_header);
 }
 
@@ -3965,6 +4773,7 @@ typedef struct
    stbi__context *s;
    stbi_uc *idata, *expanded, *out;
    int depth;
+   int direct; // rows are unfiltered straight into s->out_dst
 } stbi__png;
 
 
@@ -3999,6 +4808,165 @@ static int stbi__paeth(int a, int b, int c)
    return c;
 }
 
+#ifdef STBI_SSE2
+// Sub, Avg and Paeth each depend on the pixel just decoded to the left, so
+// they go one 3- or 4-byte pixel per step, widened to 16 bits for Paeth. Up
+// has no such chain and goes a whole register at a time.
+
+// bpp is only ever 3 or 4; both get fixed-size moves even when the
+// compiler doesn't propagate it
+static __m128i stbi__load_pixel(const stbi_uc *p, int bpp)
+{
+   int v;
+   if (bpp == 4) memcpy(&v, p, 4);
+   else          v = p[0] | (p[1] << 8) | (p[2] << 16);
+   return _mm_cvtsi32_si128(v);
+}
+
+static void stbi__store_pixel(stbi_uc *p, __m128i v, int bpp)
+{
+   int x = _mm_cvtsi128_si32(v);
+   if (bpp == 4) memcpy(p, &x, 4);
+   else {
+      p[0] = STBI__BYTECAST(x);
+      p[1] = STBI__BYTECAST(x >> 8);
+      p[2] = STBI__BYTECAST(x >> 16);
+   }
+}
+
+static __m128i stbi__select(__m128i mask, __m128i a, __m128i b)
+{
+   return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+static void stbi__unfilter_sub_sse2(stbi_uc *cur, const stbi_uc *raw, int nk, int bpp)
+{
+   __m128i a = stbi__load_pixel(cur - bpp, bpp);
+   int k;
+   for (k=0; k < nk; k += bpp) {
+      a = _mm_add_epi8(a, stbi__load_pixel(raw + k, bpp));
+      stbi__store_pixel(cur + k, a, bpp);
+   }
+}
+
+static void stbi__unfilter_up_sse2(stbi_uc *cur, const stbi_uc *prior, const stbi_uc *raw, int nk)
+{
+   int k = 0;
+   for (; k + 16 <= nk; k += 16) {
+      __m128i sum = _mm_add_epi8(_mm_loadu_si128((const __m128i *) (raw + k)), _mm_loadu_si128((const __m128i *) (prior + k)));
+      _mm_storeu_si128((__m128i *) (cur + k), sum);
+   }
+   for (; k < nk; ++k)
+      cur[k] = STBI__BYTECAST(raw[k] + prior[k]);
+}
+
+static void stbi__unfilter_avg_sse2(stbi_uc *cur, const stbi_uc *prior, const stbi_uc *raw, int nk, int bpp)
+{
+   __m128i a = stbi__load_pixel(cur - bpp, bpp), one = _mm_set1_epi8(1);
+   int k;
+   for (k=0; k < nk; k += bpp) {
+      __m128i b = stbi__load_pixel(prior + k, bpp);
+      // avg_epu8 rounds up; take the odd bit back off to get (a+b)>>1
+      __m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+      a = _mm_add_epi8(avg, stbi__load_pixel(raw + k, bpp));
+      stbi__store_pixel(cur + k, a, bpp);
+   }
+}
+
+// pa, pb and pc as in stbi__paeth: |b-c|, |a-c| and |a+b-2c|. ties go to
+// a, then b, as there.
+#define STBI__PAETH_STEP(abs16)                                                  \
+   __m128i b = _mm_unpacklo_epi8(stbi__load_pixel(prior + k, bpp), zero);        \
+   __m128i pa = _mm_sub_epi16(b, c), pb = _mm_sub_epi16(a, c);                   \
+   __m128i pc = abs16(_mm_add_epi16(pa, pb)), smallest, nearest;                 \
+   pa = abs16(pa);                                                               \
+   pb = abs16(pb);                                                               \
+   smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));                          \
+   nearest = stbi__select(_mm_cmpeq_epi16(smallest, pa), a,                      \
+             stbi__select(_mm_cmpeq_epi16(smallest, pb), b, c));                 \
+   a = _mm_and_si128(_mm_add_epi16(nearest, _mm_unpacklo_epi8(stbi__load_pixel(raw + k, bpp), zero)), low_bytes); \
+   stbi__store_pixel(cur + k, _mm_packus_epi16(a, a), bpp);                      \
+   c = b;
+
+static __m128i stbi__abs_epi16_sse2(__m128i x)
+{
+   return _mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x));
+}
+
+static void stbi__unfilter_paeth_sse2(stbi_uc *cur, const stbi_uc *prior, const stbi_uc *raw, int nk, int bpp)
+{
+   __m128i zero = _mm_setzero_si128(), low_bytes = _mm_set1_epi16(0xff);
+   __m128i a = _mm_unpacklo_epi8(stbi__load_pixel(cur - bpp, bpp), zero);
+   __m128i c = _mm_unpacklo_epi8(stbi__load_pixel(prior - bpp, bpp), zero);
+   int k;
+   for (k=0; k < nk; k += bpp) {
+      STBI__PAETH_STEP(stbi__abs_epi16_sse2)
+   }
+}
+
+#ifdef STBI__X86_DISPATCH
+static STBI__TARGET_SSSE3 void stbi__unfilter_paeth_ssse3(stbi_uc *cur, const stbi_uc *prior, const stbi_uc *raw, int nk, int bpp)
+{
+   __m128i zero = _mm_setzero_si128(), low_bytes = _mm_set1_epi16(0xff);
+   __m128i a = _mm_unpacklo_epi8(stbi__load_pixel(cur - bpp, bpp), zero);
+   __m128i c = _mm_unpacklo_epi8(stbi__load_pixel(prior - bpp, bpp), zero);
+   int k;
+   for (k=0; k < nk; k += bpp) {
+      STBI__PAETH_STEP(_mm_abs_epi16)
+   }
+}
+
+static STBI__TARGET_AVX2 void stbi__unfilter_up_avx2(stbi_uc *cur, const stbi_uc *prior, const stbi_uc *raw, int nk)
+{
+   int k = 0;
+   for (; k + 32 <= nk; k += 32) {
+      __m256i sum = _mm256_add_epi8(_mm256_loadu_si256((const __m256i *) (raw + k)), _mm256_loadu_si256((const __m256i *) (prior + k)));
+      _mm256_storeu_si256((__m256i *) (cur + k), sum);
+   }
+   for (; k < nk; ++k)
+      cur[k] = STBI__BYTECAST(raw[k] + prior[k]);
+}
+#endif
+#undef STBI__PAETH_STEP
+
+// unfilters the row after its first pixel; returns 0 to leave it to the
+// scalar loops (the synthetic first-row filters, or other pixel sizes)
+static int stbi__unfilter_row_simd(int filter, stbi_uc *cur, const stbi_uc *prior, const stbi_uc *raw, int nk, int bpp, int level)
+{
+   if (level < STBI_SIMD_SSE2 || (bpp != 3 && bpp != 4)) return 0;
+
+   switch (filter) {
+      case STBI__F_sub:
+         // a constant bpp lets the pixel loads become single moves
+         if (bpp == 4) stbi__unfilter_sub_sse2(cur, raw, nk, 4);
+         else          stbi__unfilter_sub_sse2(cur, raw, nk, 3);
+         return 1;
+      case STBI__F_up:
+         #ifdef STBI__X86_DISPATCH
+         if (level >= STBI_SIMD_AVX2) { stbi__unfilter_up_avx2(cur, prior, raw, nk); return 1; }
+         #endif
+         stbi__unfilter_up_sse2(cur, prior, raw, nk);
+         return 1;
+      case STBI__F_avg:
+         if (bpp == 4) stbi__unfilter_avg_sse2(cur, prior, raw, nk, 4);
+         else          stbi__unfilter_avg_sse2(cur, prior, raw, nk, 3);
+         return 1;
+      case STBI__F_paeth:
+         #ifdef STBI__X86_DISPATCH
+         if (level >= STBI_SIMD_SSSE3) {
+            if (bpp == 4) stbi__unfilter_paeth_ssse3(cur, prior, raw, nk, 4);
+            else          stbi__unfilter_paeth_ssse3(cur, prior, raw, nk, 3);
+            return 1;
+         }
+         #endif
+         if (bpp == 4) stbi__unfilter_paeth_sse2(cur, prior, raw, nk, 4);
+         else          stbi__unfilter_paeth_sse2(cur, prior, raw, nk, 3);
+         return 1;
+   }
+   return 0;
+}
+#endif // STBI_SSE2
+
 static stbi_uc stbi__depth_scale_table[9] = { 0, 0xff, 0x55, 0, 0x11, 0,0,0, 0x01 };
 
 // create the png data from post-deflated data
@@ -4014,10 +4982,17 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
    int output_bytes = out_n*bytes;
    int filter_bytes = img_n*bytes;
    int width = x;
+   #ifdef STBI_SSE2
+   int simd_level = depth == 8 ? stbi_get_simd_level() : STBI_SIMD_NONE;
+   #endif
 
    STBI_ASSERT(out_n == s->img_n || out_n == s->img_n+1);
-   a->out = (stbi_uc *) stbi__malloc(x * y * output_bytes); // extra bytes to write off the end into
-   if (!a->out) return stbi__err("outofmem", "Out of memory");
+   if (a->direct) {
+      if (!stbi__out_fits(s)) return stbi__err("too large", "Image larger than destination");
+   } else {
+      a->out = (stbi_uc *) stbi__malloc(x * y * output_bytes); // extra bytes to write off the end into
+      if (!a->out) return stbi__err("outofmem", "Out of memory");
+   }
 
    img_width_bytes = (((img_n * x * depth) + 7) >> 3);
    img_len = (img_width_bytes + 1) * y;
@@ -4028,10 +5003,17 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
    }
 
    for (j=0; j < y; ++j) {
-      stbi_uc *cur = a->out + stride*j;
-      stbi_uc *prior = cur - stride;
+      stbi_uc *cur, *prior;
       int filter = *raw++;
 
+      if (a->direct) {
+         cur = stbi__out_row(s, j);
+         prior = j ? stbi__out_row(s, j-1) : cur; // first row never reads prior
+      } else {
+         cur = a->out + stride*j;
+         prior = cur - stride;
+      }
+
       if (filter > 4)
          return stbi__err("invalid filter","Corrupt PNG");
 
@@ -4081,6 +5063,12 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
       // this is a little gross, so that we don't switch per-pixel or per-component
       if (depth < 8 || img_n == out_n) {
          int nk = (width - 1)*filter_bytes;
+         #ifdef STBI_SSE2
+         if (stbi__unfilter_row_simd(filter, cur, prior, raw, nk, filter_bytes, simd_level)) {
+            raw += nk;
+            continue;
+         }
+         #endif
          #define CASE(f) \
              case f:     \
                 for (k=0; k < nk; ++k)
@@ -4254,6 +5242,31 @@ static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint3
    return 1;
 }
 
+// the exact size of the filtered image data inflate produces: each row is a
+// filter byte and the packed samples, for each of the 7 passes if interlaced
+static int stbi__png_raw_len(stbi__png *a, int depth, int interlaced, stbi__uint32 *raw_len)
+{
+   int xorig[] = { 0,4,0,2,0,1,0 };
+   int yorig[] = { 0,0,4,0,2,0,1 };
+   int xspc[]  = { 8,8,4,4,2,2,1 };
+   int yspc[]  = { 8,8,8,4,4,2,2 };
+   stbi__uint64 len = 0;
+   int p;
+   if (!interlaced) {
+      len = ((((stbi__uint64) a->s->img_n * a->s->img_x * depth + 7) >> 3) + 1) * a->s->img_y;
+   } else {
+      for (p=0; p < 7; ++p) {
+         stbi__uint64 x = (a->s->img_x - xorig[p] + xspc[p]-1) / xspc[p];
+         stbi__uint64 y = (a->s->img_y - yorig[p] + yspc[p]-1) / yspc[p];
+         if (x && y) // empty passes have no filter bytes either
+            len += (((a->s->img_n * x * depth + 7) >> 3) + 1) * y;
+      }
+   }
+   if (len > 0x7fffffff) return stbi__err("too large", "Image too large to decode");
+   *raw_len = (stbi__uint32) len;
+   return 1;
+}
+
 static int stbi__compute_transparency(stbi__png *z, stbi_uc tc[3], int out_n)
 {
    stbi__context *s = z->s;
@@ -4430,6 +5443,7 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
    z->expanded = NULL;
    z->idata = NULL;
    z->out = NULL;
+   z->direct = 0;
 
    if (!stbi__check_png_header(s)) return 0;
 
@@ -4529,13 +5543,13 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
          }
 
          case STBI__PNG_TYPE('I','E','N','D'): {
-            stbi__uint32 raw_len, bpl;
+            stbi__uint32 raw_len;
             if (first) return stbi__err("first not IHDR", "Corrupt PNG");
             if (scan != STBI__SCAN_load) return 1;
             if (z->idata == NULL) return stbi__err("no IDAT","Corrupt PNG");
-            // initial guess for decoded data size to avoid unnecessary reallocs
-            bpl = (s->img_x * z->depth + 7) / 8; // bytes per line, per component
-            raw_len = bpl * s->img_y * s->img_n /* pixels */ + s->img_y /* filter mode per row */;
+            // allocate the decoded data once; the buffer still grows if the
+            // stream holds more than the image needs
+            if (!stbi__png_raw_len(z, z->depth, interlace, &raw_len)) return 0;
             z->expanded = (stbi_uc *) stbi_zlib_decode_malloc_guesssize_headerflag((char *) z->idata, ioff, raw_len, (int *) &raw_len, !is_iphone);
             if (z->expanded == NULL) return 0; // zlib should set error
             STBI_FREE(z->idata); z->idata = NULL;
@@ -4543,6 +5557,10 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
                s->img_out_n = s->img_n+1;
             else
                s->img_out_n = s->img_n;
+            // anything that needs a later pass over the whole image, or a
+            // format conversion, still decodes into its own buffer
+            z->direct = s->out_dst != NULL && z->depth == 8 && !interlace && !pal_img_n && !has_trans
+                        && !(is_iphone && stbi__de_iphone_flag) && s->img_out_n == req_comp;
             if (!stbi__create_png_image(z, z->expanded, raw_len, s->img_out_n, z->depth, color, interlace)) return 0;
             if (has_trans) {
                if (z->depth == 16) {
@@ -4597,7 +5615,7 @@ static unsigned char *stbi__do_png(stbi__png *p, int *x, int *y, int *n, int req
             return result;
          }
       }
-      result = p->out;
+      result = p->direct ? p->s->out_dst : p->out;
       p->out = NULL;
       if (req_comp && req_comp != p->s->img_out_n) {
          result = stbi__convert_format(result, p->s->img_out_n, req_comp, p->s->img_x, p->s->img_y);